@@ -0,0 +1,51 @@
+/*
+    CRC64
+    Tables and the slicing-by-8 loop for crc64.h.
+    t[0] is the usual byte at a time table, t[k] is the effect of a byte followed by k
+    zero bytes, so eight bytes are folded in at once. The tables are built on first use.
+*/
+
+#include "crc64.h"
+#include <pthread.h>
+#include <string.h>
+
+/* 0xad93d23594c935a9 with its bits reversed */
+#define CRC64_POLY          0x95ac9329ac4bc9b5ULL
+
+static uint64_t t[8][256];
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void crc64_init(){
+    uint64_t c;
+    int n, k;
+    for(n=0;n<256;n++){
+        c = n;
+        for(k=0;k<8;k++)
+            c = c & 1 ? (c >> 1) ^ CRC64_POLY : c >> 1;
+        t[0][n] = c;
+    }
+    for(n=0;n<256;n++)
+        for(k=1;k<8;k++)
+            t[k][n] = (t[k-1][n] >> 8) ^ t[0][t[k-1][n] & 0xff];
+}
+
+uint64_t crc64(uint64_t crc, const void *p, size_t n){
+    const unsigned char *b = p;
+    uint64_t w;
+    pthread_once(&once,crc64_init);
+    while(n >= 8){
+        memcpy(&w,b,8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        w = __builtin_bswap64(w);
+#endif
+        crc ^= w;
+        crc = t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^ t[5][(crc >> 16) & 0xff] ^
+              t[4][(crc >> 24) & 0xff] ^ t[3][(crc >> 32) & 0xff] ^ t[2][(crc >> 40) & 0xff] ^
+              t[1][(crc >> 48) & 0xff] ^ t[0][crc >> 56];
+        b += 8;
+        n -= 8;
+    }
+    while(n-- > 0)
+        crc = t[0][(crc ^ *b++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
@@ -0,0 +1,17 @@
+/*
+    CRC64
+    The checksum Redis appends to an RDB file: CRC-64 with the Jones polynomial, reflected,
+    starting from 0 with no final xor. Computed slicing-by-8, eight table lookups for every
+    eight bytes instead of one per byte. crc64(0,"123456789",9) is 0xe9c6d914c4b8d9ca.
+*/
+
+#ifndef CRC64_H
+#define CRC64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Carry on from crc over n more bytes, start with 0 */
+uint64_t crc64(uint64_t crc, const void *p, size_t n);
+
+#endif
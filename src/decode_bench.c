@@ -0,0 +1,447 @@
+/*
+    Decode Benchmark
+    Times dumpread's innermost decoders on byte streams built in memory, no file or disk in
+    the way: get_length(), the integer and raw branches of str_enc(), zi_next() over a
+    ziplist and strtou64(). dumpread.c is included whole so the functions measured are the
+    very ones dumpread runs, static and inlined the same way.
+    HOW TO RUN:
+        decode_bench [optional:items] [optional:repeats]
+    ARGUMENTS:
+        [items]     - Optional. Encodings in each stream, 1000000 by default
+        [repeats]   - Optional. Passes over each stream, the median and fastest are shown, 7
+                      by default
+    RETURN CODES:
+        0 - Success!
+        1 - Bad arguments
+        2 - Out of memory, or a decoder read back something other than what was written
+    NOTES:
+        Every decoder runs over two streams: "mixed" has the encodings in the proportions an
+            RDB file of small keys has them, shuffled, "same" has only the most common one. The
+            gap between the two is what branch mispredictions cost.
+        Branches and branch misses per op come from perf_event_open(2) when the kernel lets
+            us count them (see /proc/sys/kernel/perf_event_paranoid), "-" otherwise.
+        LZF strings are left to lzf_bench.
+*/
+
+#define main dumpread_main
+#include "dumpread.c"
+#undef main
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define DB_ITEMS            1000000
+#define DB_REPEATS          7
+
+/*
+    SB : Stream Buffer
+        p   = bytes
+        len = bytes used
+        cap = bytes allocated
+*/
+struct SB {
+    unsigned char *p;
+    size_t len;
+    size_t cap;
+};
+
+/*
+    BR : Bench Result
+        ns     = nanoseconds per op of every pass, sorted once they are all in
+        branch = branches per op, -1 when they couldn't be counted
+        miss   = branch misses per op, -1 the same
+*/
+struct BR {
+    double ns[64];
+    double branch;
+    double miss;
+};
+
+/* What a stream holds and how it is decoded */
+enum { D_LENGTH, D_STRING, D_STRING_FULL, D_ZIPLIST, D_STRTOU64 };
+
+static uint64_t seed = 1;
+static volatile uint64_t sink;
+static int pe_branch = -1, pe_miss = -1;
+
+static uint64_t rnd(){
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545F4914F6CDD1DULL;
+}
+
+static int sb_room(struct SB *b, size_t n){
+    while(b->cap - b->len < n){
+        b->cap = b->cap ? b->cap * 2 : 1 << 16;
+        b->p = realloc(b->p,b->cap);
+        if(b->p == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+static void sb_put(struct SB *b, const void *p, size_t n){
+    if(sb_room(b,n) == 0){
+        memcpy(b->p + b->len,p,n);
+        b->len += n;
+    }
+}
+
+static void sb_byte(struct SB *b, uint8_t c){
+    sb_put(b,&c,1);
+}
+
+/* Pick an index by weight */
+static int pick(const unsigned int *w, int n){
+    unsigned int total = 0, r;
+    int i;
+    for(i=0;i<n;i++)
+        total += w[i];
+    r = rnd() % total;
+    for(i=0;r >= w[i];i++)
+        r -= w[i];
+    return i;
+}
+
+/* RDB length encodings: 6 bit, 14 bit, 32 bit big endian and 64 bit big endian */
+static void put_length(struct SB *b, int kind){
+    uint64_t v;
+    int i;
+    switch(kind){
+        case 0:
+            sb_byte(b,rnd() % 64);
+            break;
+        case 1:
+            v = 64 + rnd() % (16384 - 64);
+            sb_byte(b,0x40 | (v >> 8));
+            sb_byte(b,v & 0xFF);
+            break;
+        case 2:
+            v = 16384 + rnd() % 1000000;
+            sb_byte(b,0x80);
+            for(i=3;i>=0;i--)
+                sb_byte(b,v >> (8*i));
+            break;
+        default:
+            v = ((uint64_t)1 << 32) + rnd() % 1000000;
+            sb_byte(b,0x81);
+            for(i=7;i>=0;i--)
+                sb_byte(b,v >> (8*i));
+    }
+}
+
+/* A string value: 8, 16 or 32 bit integer or a short raw string */
+static void put_string(struct SB *b, int kind){
+    int32_t v = rnd();
+    size_t n;
+    switch(kind){
+        case 0:
+            sb_byte(b,0xC0);
+            sb_put(b,&v,1);
+            break;
+        case 1:
+            sb_byte(b,0xC1);
+            sb_put(b,&v,2);
+            break;
+        case 2:
+            sb_byte(b,0xC2);
+            sb_put(b,&v,4);
+            break;
+        default:
+            n = 1 + rnd() % 40;
+            sb_byte(b,n);
+            if(sb_room(b,n) == 0){
+                memset(b->p + b->len,'a' + n % 26,n);
+                b->len += n;
+            }
+    }
+}
+
+/* Every one of the nine ziplist encodings, 1 byte previous entry lengths */
+static void put_entry(struct SB *b, int kind){
+    static uint8_t prev;
+    size_t at = b->len, n;
+    int64_t v = rnd();
+    sb_byte(b,prev);
+    switch(kind){
+        case 0:
+            n = rnd() % 24;
+            sb_byte(b,n);
+            break;
+        case 1:
+            n = 64 + rnd() % 100;
+            sb_byte(b,0x40 | (n >> 8));
+            sb_byte(b,n & 0xFF);
+            break;
+        case 2:
+            /* Redis only uses it past 16383 bytes, a short one decodes the same */
+            n = 64 + rnd() % 100;
+            sb_byte(b,0x80);
+            sb_byte(b,0);
+            sb_byte(b,0);
+            sb_byte(b,0);
+            sb_byte(b,n);
+            break;
+        case 3:
+            sb_byte(b,0xC0);
+            sb_put(b,&v,2);
+            n = 0;
+            break;
+        case 4:
+            sb_byte(b,0xD0);
+            sb_put(b,&v,4);
+            n = 0;
+            break;
+        case 5:
+            sb_byte(b,0xE0);
+            sb_put(b,&v,8);
+            n = 0;
+            break;
+        case 6:
+            sb_byte(b,0xF0);
+            sb_put(b,&v,3);
+            n = 0;
+            break;
+        case 7:
+            sb_byte(b,0xFE);
+            sb_put(b,&v,1);
+            n = 0;
+            break;
+        default:
+            sb_byte(b,0xF1 + rnd() % 13);
+            n = 0;
+    }
+    if(n > 0 && sb_room(b,n) == 0){
+        memset(b->p + b->len,'z',n);
+        b->len += n;
+    }
+    prev = b->len - at;
+}
+
+/* Decimal numbers of 1 to 20 digits, NUL separated, len gets the length of each */
+static void put_number(struct SB *b, unsigned char *len, int same){
+    char num[24];
+    int n = same ? 10 : 1 + rnd() % 20, i;
+    for(i=0;i<n;i++)
+        num[i] = '0' + (i == 0 ? 1 + rnd() % 9 : rnd() % 10);
+    sb_put(b,num,n);
+    sb_byte(b,0);
+    *len = n;
+}
+
+/*
+    Build the stream for decoder d. Mixed weights are about what a file of small keys has,
+    same uses only the first (most common) encoding.
+*/
+static int build(struct SB *b, unsigned char **lens, int d, int same, unsigned long items){
+    static const unsigned int wlen[4] = {80, 17, 2, 1};
+    static const unsigned int wstr[4] = {50, 15, 15, 20};
+    static const unsigned int wzl[9] = {45, 5, 1, 8, 6, 2, 4, 9, 20};
+    unsigned long i;
+    b->len = 0;
+    if(d == D_STRTOU64 && (*lens = malloc(items)) == NULL)
+        return -1;
+    if(d == D_ZIPLIST){
+        /* zlbytes, zltail and zllen, zi_next() goes by the length it is given */
+        if(sb_room(b,10) != 0)
+            return -1;
+        memset(b->p,0,10);
+        b->len = 10;
+    }
+    for(i=0;i<items;i++){
+        switch(d){
+            case D_LENGTH:
+                put_length(b,same ? 0 : pick(wlen,4));
+                break;
+            case D_STRING:
+            case D_STRING_FULL:
+                put_string(b,same ? 0 : pick(wstr,4));
+                break;
+            case D_ZIPLIST:
+                put_entry(b,same ? 0 : pick(wzl,9));
+                break;
+            default:
+                put_number(b,*lens + i,same);
+        }
+        if(b->p == NULL)
+            return -1;
+    }
+    if(d == D_ZIPLIST)
+        sb_byte(b,0xFF);
+    return b->p == NULL ? -1 : 0;
+}
+
+static void rr_mem(struct RR *r, unsigned char *p, size_t n){
+    memset(r,0,sizeof(struct RR));
+    r->map = p;
+    r->cur = p;
+    r->end = p + n;
+    r->size = n;
+    r->fd = -1;
+}
+
+/* One pass over the stream, returns how many items were decoded */
+static unsigned long pass(struct SB *b, unsigned char *lens, int d, unsigned long items){
+    struct RR r;
+    struct ZI it;
+    struct ZE e;
+    struct KI *key;
+    unsigned char buffer[BUFFERSIZE];
+    const char *s;
+    unsigned long i, n = 0;
+    uint64_t sum = 0;
+    switch(d){
+        case D_LENGTH:
+            rr_mem(&r,b->p,b->len);
+            for(i=0;i<items;i++){
+                rr_read(&r,buffer,1);
+                sum += get_length(buffer,&r);
+            }
+            n = items;
+            break;
+        case D_STRING:
+        case D_STRING_FULL:
+            args.full = d == D_STRING_FULL;
+            rr_mem(&r,b->p,b->len);
+            for(i=0;i<items;i++){
+                if((key = str_enc(&r)) == NULL)
+                    break;
+                sum += key->size + key->len;
+                /* As often as a small key would reset it */
+                if(i % 8 == 7)
+                    ar_reset();
+            }
+            ar_reset();
+            n = i;
+            break;
+        case D_ZIPLIST:
+            zi_zl(&it,(const char*)b->p,b->len);
+            while(zi_next(&it,&e)){
+                sum += e.len + e.num;
+                n++;
+            }
+            break;
+        default:
+            s = (const char*)b->p;
+            for(i=0;i<items;i++){
+                sum += strtou64(s,lens[i]);
+                s += lens[i] + 1;
+            }
+            n = items;
+    }
+    sink += sum;
+    return n;
+}
+
+static int pe_open(uint64_t config){
+    struct perf_event_attr a;
+    memset(&a,0,sizeof(a));
+    a.type = PERF_TYPE_HARDWARE;
+    a.size = sizeof(a);
+    a.config = config;
+    a.disabled = 1;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    return syscall(__NR_perf_event_open,&a,0,-1,-1,0);
+}
+
+static uint64_t pe_read(int fd){
+    uint64_t v = 0;
+    if(fd < 0 || read(fd,&v,sizeof(v)) != sizeof(v))
+        return 0;
+    return v;
+}
+
+static void pe_toggle(int on){
+    int req = on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE;
+    if(pe_branch >= 0){
+        if(on)
+            ioctl(pe_branch,PERF_EVENT_IOC_RESET,0);
+        ioctl(pe_branch,req,0);
+    }
+    if(pe_miss >= 0){
+        if(on)
+            ioctl(pe_miss,PERF_EVENT_IOC_RESET,0);
+        ioctl(pe_miss,req,0);
+    }
+}
+
+static int cmp_double(const void *a, const void *b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Time repeats passes, the branch counts are of the last one */
+static int bench(struct SB *b, unsigned char *lens, int d, unsigned long items, int repeats, struct BR *res){
+    struct timespec begin, end;
+    unsigned long n = 0;
+    int k;
+    /* A pass to warm the caches and check the whole stream decodes */
+    if(pass(b,lens,d,items) != items)
+        return -1;
+    for(k=0;k<repeats;k++){
+        if(k == repeats - 1)
+            pe_toggle(1);
+        clock_gettime(CLOCK_MONOTONIC,&begin);
+        n = pass(b,lens,d,items);
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        res->ns[k] = ((end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec)) / n;
+    }
+    pe_toggle(0);
+    qsort(res->ns,repeats,sizeof(double),cmp_double);
+    res->branch = pe_branch >= 0 ? (double)pe_read(pe_branch) / n : -1;
+    res->miss = pe_miss >= 0 ? (double)pe_read(pe_miss) / n : -1;
+    return 0;
+}
+
+int main(int argc, char **argv){
+    static const char *name[] = {"get_length", "str_enc", "str_enc full", "zi_next", "strtou64"};
+    struct SB b = {NULL, 0, 0};
+    struct BR res;
+    unsigned char *lens = NULL;
+    unsigned long items = DB_ITEMS;
+    int repeats = DB_REPEATS, d, same, rc = 0;
+    if(argc > 3 || (argc > 1 && (items = strtoul(argv[1],NULL,10)) == 0) ||
+            (argc > 2 && ((repeats = atoi(argv[2])) < 1 || repeats > 64))){
+        fprintf(stderr,"Usage : decode_bench [optional:items] [optional:repeats (1-64)]\n");
+        return 1;
+    }
+    memset(&args,0,sizeof(args));
+    pe_branch = pe_open(PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+    pe_miss = pe_open(PERF_COUNT_HW_BRANCH_MISSES);
+    fprintf(stdout,"%lu items per stream, median and fastest of %d passes\n",items,repeats);
+    fprintf(stdout,"%-14s %-6s %12s %12s %14s %14s\n","Decoder","Stream","ns/op","min ns/op","branches/op","misses/op");
+    for(d=D_LENGTH;d<=D_STRTOU64;d++){
+        for(same=0;same<2;same++){
+            seed = 1;
+            if(build(&b,&lens,d,same,items) != 0){
+                fprintf(stderr,"ERROR : Could not build the %s stream\n",name[d]);
+                rc = 2;
+                goto end;
+            }
+            if(bench(&b,lens,d,items,repeats,&res) != 0){
+                fprintf(stderr,"ERROR : %s didn't decode its whole stream\n",name[d]);
+                rc = 2;
+                goto end;
+            }
+            fprintf(stdout,"%-14s %-6s %12.2f %12.2f",name[d],same ? "same" : "mixed",res.ns[repeats/2],res.ns[0]);
+            if(res.branch >= 0)
+                fprintf(stdout," %14.2f %14.3f\n",res.branch,res.miss);
+            else
+                fprintf(stdout," %14s %14s\n","-","-");
+            free(lens);
+            lens = NULL;
+        }
+    }
+end:
+    free(lens);
+    free(b.p);
+    ar_release();
+    if(pe_branch >= 0)
+        close(pe_branch);
+    if(pe_miss >= 0)
+        close(pe_miss);
+    return rc;
+}
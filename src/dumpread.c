@@ -1,17 +1,81 @@
 /* Michael Coates : mcoates@wayfair.com : @outerwear
     Reading and converting a binary dump file from Redis
     HOW TO RUN:
-        dumpread [filename1] [filename2] [optional:full] [optional:silent]
+        dumpread --batch [out dir] [rdb file]... [optional:full] [optional:silent] [optional:--options]
+        dumpread [filename1] [filename2] [optional:full] [optional:silent] [optional:--threads N] [optional:--pipeline] [optional:--direct]
+                 [optional:--aggregate-prefixes[=short]] [optional:--lzf-threads N]
+                 [optional:--top N] [optional:--histograms[=FILE]] [optional:--expiry]
+                 [optional:--match GLOB] [optional:--match-re REGEX] [optional:--verify]
+                 [optional:--progress-ms N] [optional:--progress-json FILE] [optional:--profile]
+                 [optional:--stream-values[=BYTES]] [optional:--max-value N]
     ARGUMENTS:
-        [filename1] - RDB file to be parsed
+        [--batch]   - Parse every RDB file listed, up to the first option or full/silent, on a
+                      pool of --threads threads (every online CPU by default, one at a time
+                      for files on the same spinning disk). Each gets [out dir]/NAME.out as
+                      its out file and [out dir]/merged.out gets the totals of them all.
+                      --pipeline is ignored.
+        [filename1] - RDB file to be parsed, - reads it from stdin (redis-cli --rdb -, ssh host cat ...)
         [filename2] - Output file to contain all key information
         [full]      - Optional. Includes value in out file.
         [silent]    - Optional. Prevents anything being written to STDOUT.
+        [--threads] - Optional. Parse with N threads, 0 uses every online CPU. A quick index
+                      pass splits the file on key boundaries, the output stays in file order.
+                      With --batch it is how many files are parsed at once instead.
+        [--pipeline]- Optional. Format and write the out file on their own threads so they overlap
+                      with the parse. With --threads only the writes move to a thread.
+        [--aggregate-prefixes]
+                    - Optional. Feed every key straight into the prefix tool's trie and print its
+                      table (=short for the comma delimited one) instead of writing each key to
+                      the out file, which then only gets the totals.
+        [--top]     - Optional. List the N biggest keys overall, of each type and in each db at the
+                      end of the out file and the summary, not just the largest one.
+        [--histograms]
+                    - Optional. Log bucketed histograms of size, element count and TTL for each
+                      type, printed as percentiles with the totals. =FILE also writes every
+                      bucket to FILE as CSV.
+        [--expiry]  - Optional. Add up the size of the keys by when they expire (within a minute,
+                      hour, day, week, ...) and the ones with no TTL, overall and by key prefix.
+        [--match]   - Optional. Only keys whose name matches the glob (Redis KEYS style) are read,
+                      the values of the rest are skipped over using their length headers alone.
+                      Can be given more than once, a key matching any of them is kept.
+        [--match-re]- Optional. Same with an extended regex, found anywhere in the name unless
+                      anchored with ^ or $. Globs and regexes are compiled into one DFA.
+        [--verify]  - Optional. Check the CRC64 at the end of the file against its contents and
+                      that the file ends right after it. A mapped file is checksummed on a
+                      thread of its own during the parse, a stream as it is read.
+        [--progress-ms]
+                    - Optional. How often the progress line (keys/s, MB/s and ETA) is redrawn,
+                      1000 by default. It is read off counters the parser threads keep, so
+                      --threads and --batch runs get one too.
+        [--progress-json]
+                    - Optional. Also write every tick to FILE as a JSON line, for schedulers
+                      keeping an eye on long runs. Works with silent.
+        [--profile] - Optional. Count calls, bytes, time and arena allocations of every type's
+                      encoder, LZF decompression and print_key_info, and print them as a table
+                      on stderr at the end. Costs nothing when left off.
+        [--stream-values]
+                    - Optional. In full mode write the values of lists, sets, sorted sets, hashes
+                      and their ziplist forms as their elements are decoded, through a buffer of
+                      BYTES (1MB by default) that spills to a temporary file, instead of building
+                      each one up in memory. A key with millions of elements needs no more than
+                      its biggest element. --pipeline only gets the write thread with it.
+        [--max-value]
+                    - Optional. Cut every value off after N bytes in full mode and note how many
+                      more there were. Turns on --stream-values.
+        [--direct]  - Optional. Write the out file with O_DIRECT and preallocate it, for multi GB
+                      outputs that would otherwise push everything else out of the page cache.
+        [--lzf-threads]
+                    - Optional. Decompress large compressed strings on N threads of their own in
+                      full mode. A quicklist's nodes are handed off as they are read and put back
+                      together in order once the whole key has been read. With --pipeline
+                      a big compressed string value is left to them and the formatter, the
+                      parser goes on to the next keys in the meantime.
     RETURN CODES:
         0 - Success!
         1 - Not enough arguments passed in
         2 - Bad file descriptor. Could be wrong path or permissions issue.
         3 - Not RDB file type.
+        4 - With --verify, the checksum doesn't match or the file doesn't end where it should.
     NOTES: 
         Ziplists use 0xFF to indicate end so if that is not grabbed correctly we may prematurely exit.
         But where are my keys?! Redis bgsave will not save expired keys. However the redis-cli info
@@ -21,13 +85,31 @@
             only for rdb files of smaller size (a few GB).
  */
 
-#define _GNU_SOURCE     /* for asprintf() */
+#define _GNU_SOURCE
 #include "lzf.h"
+#include "reader.h"
+#include "writer.h"
+#include "trie.h"
+#include "top.h"
+#include "crc64.h"
+#include "hist.h"
+#include "match.h"
+#include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 
 #define BUFFERSIZE          10
@@ -69,55 +151,525 @@
     #define DEBUG           0
 #endif
 #define debug_print(...)    do{if(DEBUG)fprintf(stderr,__VA_ARGS__);}while(0)
-#define print_usage         fprintf(stderr,"Usage : dumpread [rdb file] [out file] [optional:full] [optional:silent]\n")
+#define print_usage         fprintf(stderr,"Usage : dumpread [rdb file] [out file] | --batch [out dir] [rdb file]... [optional:full] [optional:silent] [optional:--threads N] [optional:--pipeline] [optional:--direct] [optional:--aggregate-prefixes[=short]] [optional:--lzf-threads N] [optional:--top N] [optional:--histograms[=FILE]] [optional:--expiry] [optional:--match GLOB] [optional:--match-re REGEX] [optional:--verify] [optional:--progress-ms N] [optional:--progress-json FILE] [optional:--profile] [optional:--stream-values[=BYTES]] [optional:--max-value N]\n")
 
 /*
     aux tells us if it is an aux key which has special str_enc()
+    name is set while a key name is read for --match, which needs it even in summary mode
+    It is per thread since parallel workers each parse their own range
 */
-struct {
+__thread struct {
     unsigned int x : 1;
+    unsigned int name : 1;
 } aux;
 
 /* Arg vars */
 struct {
     uint8_t noisy : 1;
     uint8_t full  : 1;
+    uint8_t direct : 1;
+    uint8_t pipeline : 1;
+    uint8_t prefixes : 1;
+    uint8_t pretty : 1;
+    uint8_t hist : 1;
+    uint8_t expiry : 1;
+    uint8_t batch : 1;
+    uint8_t verify : 1;
+    uint8_t profile : 1;
+    uint8_t stream : 1;
+    const char *hist_csv;
+    const char *progress_json;
+    unsigned int progress_ms;
+    struct KM *match;
+    char **files;
+    int nfiles;
+    int threads;
+    int lzf_threads;
+    unsigned int top;
+    unsigned long value_buf;
+    unsigned long max_value;
 } args;
 
+/*
+    AR : Key Arena
+        Everything a key needs while it is being parsed (the KIs, copied strings, ziplist
+        entries, decompression buffers) is bumped out of the arena and thrown away at once
+        by ar_reset() after print_key_info(). There is one per thread, like aux.
+        head = first block, kept across resets so most keys never touch malloc
+        cur  = block being bumped from, overflow blocks are chained after head
+        used = bytes handed out since the last reset, including the bump slack
+        peak = largest used seen, the memory the biggest key needed
+        n    = allocations made, never reset, --profile counts them per stage
+    AB : Arena Block
+        next = following block
+        cap  = bytes in data
+        off  = bytes of data handed out
+*/
+#define AR_BLOCK            (64 << 10)
+#define AR_ALIGN(n)         (((n) + 7) & ~(size_t)7)
+
+struct AB {
+    struct AB *next;
+    size_t cap;
+    size_t off;
+    unsigned char data[];
+};
+
+__thread struct {
+    struct AB *head;
+    struct AB *cur;
+    size_t used;
+    size_t peak;
+    unsigned long n;
+} arena;
+
+static void* ar_alloc(size_t n){
+    struct AB *b = arena.cur;
+    size_t cap;
+    void *p;
+    n = AR_ALIGN(n);
+    arena.n++;
+    if(b == NULL || b->cap - b->off < n){
+        /* Chain a block at least twice the last one so a big key needs few of them */
+        cap = b ? b->cap * 2 : AR_BLOCK;
+        if(cap < n)
+            cap = n;
+        b = malloc(sizeof(struct AB) + cap);
+        if(b == NULL)
+            return NULL;
+        b->cap = cap;
+        b->off = 0;
+        b->next = NULL;
+        if(arena.cur == NULL)
+            arena.head = b;
+        else
+            arena.cur->next = b;
+        arena.cur = b;
+    }
+    p = b->data + b->off;
+    b->off += n;
+    arena.used += n;
+    if(arena.used > arena.peak)
+        arena.peak = arena.used;
+    return p;
+}
+
+/* Grow an allocation, in place when it was the last thing bumped and there is room */
+static void* ar_grow(void *p, size_t old, size_t n){
+    struct AB *b = arena.cur;
+    void *q;
+    old = AR_ALIGN(old);
+    if(p != NULL && b != NULL && (unsigned char*)p + old == b->data + b->off
+            && b->cap - (b->off - old) >= AR_ALIGN(n)){
+        b->off += AR_ALIGN(n) - old;
+        arena.used += AR_ALIGN(n) - old;
+        if(arena.used > arena.peak)
+            arena.peak = arena.used;
+        return p;
+    }
+    q = ar_alloc(n);
+    if(q != NULL && p != NULL)
+        memcpy(q,p,old < n ? old : n);
+    return q;
+}
+
+/*
+    AM : Arena Mark, where the arena was, ar_rewind() hands back everything bumped since
+        b    = block being bumped from, NULL when the arena had none yet
+        off  = bytes of b handed out
+        used = arena.used
+*/
+struct AM {
+    struct AB *b;
+    size_t off;
+    size_t used;
+};
+
+static void ar_mark(struct AM *m){
+    m->b = arena.cur;
+    m->off = arena.cur ? arena.cur->off : 0;
+    m->used = arena.used;
+}
+
+static void ar_rewind(struct AM *m){
+    struct AB *b = m->b ? m->b : arena.head, *next, *p;
+    if(b == NULL)
+        return;
+    for(p = b->next; p != NULL; p = next){
+        next = p->next;
+        free(p);
+    }
+    b->next = NULL;
+    b->off = m->b ? m->off : 0;
+    arena.cur = b;
+    arena.used = m->used;
+}
+
+/*
+    VS : Value Stream
+        With --stream-values or --max-value the text of a full mode value isn't built up in
+        the arena. The encoder vs_claim()s its value KI and whatever ki_cat() puts in it goes
+        through a fixed buffer, spilling to a temporary file once that is full, and is
+        copied to the out file by print_key_info(). The encoders of dict encoded types and
+        quicklists also rewind the arena after every element, so no key needs more memory
+        than its biggest element, whatever its size. Past --max-value bytes the text is only
+        counted. Like the arena there is one per thread.
+        key     = value being streamed, NULL when none
+        buf     = the fixed buffer, value_buf bytes
+        len     = bytes in buf
+        out     = bytes of text the value has had, kept or not
+        spill   = temporary file for what didn't fit in buf, opened the first time it is needed
+        spilled = spill holds part of the current value
+*/
+#define VS_BUFFER           (1 << 20)
+
+__thread struct {
+    struct KI *key;
+    char *buf;
+    unsigned long len;
+    unsigned long long out;
+    struct OW *spill;
+    uint8_t spilled;
+} vs;
+
+static inline void vs_claim(struct KI *key){
+    if(args.stream && vs.key == NULL)
+        vs.key = key;
+}
+
+static void vs_put(const char *s, unsigned long n){
+    unsigned long room;
+    vs.out += n;
+    if(args.max_value > 0 && vs.out > args.max_value)
+        n = vs.out - n < args.max_value ? args.max_value - (vs.out - n) : 0;
+    if(n > 0 && vs.buf == NULL && (vs.buf = malloc(args.value_buf)) == NULL){
+        fprintf(stderr,"ERROR : Could not allocate the value buffer\n");
+        return;
+    }
+    while(n > 0){
+        if(vs.len == args.value_buf){
+            if(vs.spill == NULL && (vs.spill = ow_tmp()) == NULL){
+                fprintf(stderr,"ERROR : Could not open a file to spill a value to\n");
+                return;
+            }
+            ow_put(vs.spill,vs.buf,vs.len);
+            vs.spilled = 1;
+            vs.len = 0;
+        }
+        room = args.value_buf - vs.len;
+        if(room > n)
+            room = n;
+        memcpy(vs.buf + vs.len,s,room);
+        vs.len += room;
+        s += room;
+        n -= room;
+    }
+}
+
+/* Copy the streamed value to the out file, what was cut off by --max-value is counted */
+static void vs_print(struct OW *fo){
+    if(vs.spilled && ow_append(fo,vs.spill) != 0)
+        fprintf(stderr,"ERROR : Could not copy the spilled value to the out file\n");
+    ow_put(fo,vs.buf,vs.len);
+    if(args.max_value > 0 && vs.out > args.max_value){
+        ow_put(fo," ... [truncated, ",17);
+        ow_u64(fo,vs.out - args.max_value);
+        ow_put(fo," more bytes]",12);
+    }
+}
+
+/* The value is done with, called with every ar_reset() */
+static void vs_reset(){
+    if(vs.spilled && ow_reset(vs.spill) != 0)
+        fprintf(stderr,"ERROR : Could not empty the value spill file\n");
+    vs.key = NULL;
+    vs.len = 0;
+    vs.out = 0;
+    vs.spilled = 0;
+}
+
+static void vs_release(){
+    vs_reset();
+    free(vs.buf);
+    vs.buf = NULL;
+    if(vs.spill != NULL)
+        ow_close(vs.spill);
+    vs.spill = NULL;
+}
+
+/* Drop everything handed out since the last reset, overflow blocks go back to malloc */
+static void ar_reset(){
+    struct AB *b, *next;
+    if(arena.head == NULL)
+        return;
+    for(b = arena.head->next; b != NULL; b = next){
+        next = b->next;
+        free(b);
+    }
+    arena.head->next = NULL;
+    arena.head->off = 0;
+    arena.cur = arena.head;
+    arena.used = 0;
+    if(vs.key != NULL)
+        vs_reset();
+}
+
+/*
+    Profile
+    --profile times every fptr[] encoder, LZF decompression and print_key_info(). Each
+    thread counts into its own PS array and adds it to pf_total under pf_lock once it is
+    done, nothing is shared while keys are parsed. With the flag off the stages are called
+    straight and the only cost is testing args.profile.
+    Encoder times include the LZF decompression they call.
+    PS : Profile Stage
+        calls  = times the stage ran
+        in     = bytes it consumed, of the RDB file or of compressed data
+        out    = bytes it produced, decompressed or handed to the out file
+        ticks  = time spent, TSC cycles on x86 and nanoseconds elsewhere
+        allocs = arena allocations made
+*/
+#define PF_LZF              13
+#define PF_HEAD             14
+#define PF_PRINT            15
+#define PF_STAGES           16
+
+struct PS {
+    uint64_t calls;
+    uint64_t in;
+    uint64_t out;
+    uint64_t ticks;
+    uint64_t allocs;
+};
+
+static const char *pf_name[PF_STAGES] = {
+    "str_enc", "list_enc", "set_enc", "sset_enc", "hash_enc", "sset64_enc", "mod_enc",
+    "zm_enc", "zl_enc", "is_enc", "sszl_enc", "hmzl_enc", "ql_enc",
+    "lzf_decompress", "lzf_decompress_head", "print_key_info"
+};
+
+__thread struct PS pf[PF_STAGES];
+static struct PS pf_total[PF_STAGES];
+static pthread_mutex_t pf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t pf_now(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void pf_add(int i, uint64_t t, uint64_t in, uint64_t out, unsigned long n){
+    pf[i].calls++;
+    pf[i].ticks += pf_now() - t;
+    pf[i].in += in;
+    pf[i].out += out;
+    pf[i].allocs += arena.n - n;
+}
+
+/* Hand this thread's counts over, called by every thread that ran a stage */
+static void pf_flush(){
+    int i;
+    pthread_mutex_lock(&pf_lock);
+    for(i=0;i<PF_STAGES;i++){
+        pf_total[i].calls += pf[i].calls;
+        pf_total[i].in += pf[i].in;
+        pf_total[i].out += pf[i].out;
+        pf_total[i].ticks += pf[i].ticks;
+        pf_total[i].allocs += pf[i].allocs;
+    }
+    pthread_mutex_unlock(&pf_lock);
+    memset(pf,0,sizeof(pf));
+}
+
+static unsigned int pf_lzf(const void *in, unsigned int clen, void *out, unsigned int ulen){
+    uint64_t t;
+    unsigned int got;
+    if(!args.profile)
+        return lzf_decompress_fast(in,clen,out,ulen);
+    t = pf_now();
+    got = lzf_decompress_fast(in,clen,out,ulen);
+    pf_add(PF_LZF,t,clen,got,arena.n);
+    return got;
+}
+
+static unsigned int pf_head(const void *in, unsigned int clen, void *out, unsigned int ulen){
+    uint64_t t;
+    unsigned int got;
+    if(!args.profile)
+        return lzf_decompress_head(in,clen,out,ulen);
+    t = pf_now();
+    got = lzf_decompress_head(in,clen,out,ulen);
+    pf_add(PF_HEAD,t,clen,got,arena.n);
+    return got;
+}
+
+static void ar_release(){
+    ar_reset();
+    vs_release();
+    free(arena.head);
+    arena.head = NULL;
+    arena.cur = NULL;
+}
+
 /*
     KI : Key Info Structure
         str = name/value
         size = size in bytes
+        count = elements in a list, set, sorted set or hash value, 0 for strings. Ziplists
+            with 65535 or more entries only say so, in summary mode that is what is counted
+        len = number of bytes in str
+        cap = bytes allocated for str when it is being built up with ki_cat(), 0 otherwise
+        ref = str points into the reader's mapping, it is not NUL terminated and may not be written
+        job = str is still being decompressed by the LZF pool, ki_wait() before reading it
     create_KI()
-        Allocate space for a new KI with initialized values
+        Allocate space for a new KI with initialized values out of the key arena.
+        KIs and their strings live until the next ar_reset(), there is nothing to free.
+    ki_cat()
+        Append n bytes to str. The allocation doubles as it fills so building a full
+        value is linear in its size, str stays NUL terminated.
 */
 struct KI {
     unsigned long long size;
+    unsigned long long count;
     char *str;
+    unsigned long len;
+    unsigned long cap;
+    uint8_t ref : 1;
+    struct LJ *job;
 };
 
 static struct KI* create_KI(){
-    struct KI *key = malloc(sizeof(struct KI));
+    struct KI *key = ar_alloc(sizeof(struct KI));
     if(key == NULL)
         return NULL;
     key->str = NULL;
     key->size = 0;
+    key->count = 0;
+    key->len = 0;
+    key->cap = 0;
+    key->ref = 0;
+    key->job = NULL;
     return key;
 }
 
-uint64_t strtou64(char *s){
+static void ki_cat(struct KI *key, const char *s, unsigned long n){
+    char *tmp;
+    unsigned long cap;
+    if(key == vs.key){
+        vs_put(s,n);
+        return;
+    }
+    if(key->ref || key->len + n + SPACE_FOR_NULL > key->cap){
+        cap = key->cap ? key->cap : 64;
+        while(cap < key->len + n + SPACE_FOR_NULL)
+            cap *= 2;
+        if(key->ref){
+            /* Borrowed from the mapping, take a copy we can write to */
+            tmp = ar_alloc(cap);
+            if(tmp != NULL)
+                memcpy(tmp,key->str,key->len);
+        } else {
+            tmp = ar_grow(key->str,key->cap,cap);
+        }
+        if(tmp == NULL){
+            fprintf(stderr,"ERROR : Could not grow value to %lu bytes\n",cap);
+            return;
+        }
+        key->str = tmp;
+        key->cap = cap;
+        key->ref = 0;
+    }
+    if(n > 0)
+        memcpy(key->str+key->len,s,n);
+    key->len += n;
+    key->str[key->len] = '\0';
+}
+
+/* Print a KI string, borrowed strings are not NUL terminated so go by length */
+static void ow_KI(struct KI *key, struct OW *fo){
+    if(key->ref)
+        ow_put(fo,key->str,key->len);
+    else
+        ow_puts(fo,key->str);
+}
+
+uint64_t strtou64(const char *s, unsigned long len){
     uint64_t x;
-    for(x=0; (unsigned)*s-'0'<10; s++)
+    const char *e = s + len;
+    for(x=0; s < e && (unsigned)*s-'0'<10; s++)
         x=(x*10)+(*s-'0');
     return x;
 }
 
-static char* get_zl_entry(char *c, unsigned long *offset){
+/*
+    ZE : Ziplist/Intset Entry
+        str = entry bytes in place inside the ziplist, NULL for integer entries
+        len = bytes at str
+        num = value of integer entries
+    ZI : Ziplist/Intset Iterator
+        buf = decompressed ziplist or intset
+        len = bytes in buf
+        off = offset of the next entry
+        enc = intset integer width (2,4,8), 0 when walking a ziplist
+        left = intset entries still to come
+    zi_zl() / zi_is()
+        Start an iterator over a ziplist or an intset
+    zi_next()
+        Fill in the next entry, returns 0 once the end marker or the end of buf is reached.
+        Nothing is copied or allocated, integers are turned into text with i64toa() only
+        when they are printed.
+    i64toa()
+        Signed ow_utoa(), dst needs 20 bytes and is not NUL terminated
+*/
+struct ZE {
+    const char *str;
+    unsigned long len;
+    int64_t num;
+};
+
+struct ZI {
+    const unsigned char *buf;
+    unsigned long len;
+    unsigned long off;
+    uint32_t enc;
+    uint32_t left;
+};
+
+static void zi_zl(struct ZI *it, const char *zl, unsigned long len){
+    /* Past zlbytes, zltail and zllen */
+    it->buf = (const unsigned char*)zl;
+    it->len = len;
+    it->off = 10;
+    it->enc = 0;
+    it->left = 0;
+}
+
+static int zi_is(struct ZI *it, const char *is, unsigned long len){
+    /* 4 byte encoding then 4 byte count, both little endian */
+    it->buf = (const unsigned char*)is;
+    it->len = len;
+    it->off = 8;
+    it->enc = 0;
+    it->left = 0;
+    if(len < 8)
+        return -1;
+    memcpy(&it->enc,is,4);
+    memcpy(&it->left,is+4,4);
+    if(it->enc != 2 && it->enc != 4 && it->enc != 8){
+        fprintf(stderr,"ERROR : Bad intset encoding %" PRIu32 "\n",it->enc);
+        it->left = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int zi_next(struct ZI *it, struct ZE *e){
     /* 
-        Get Ziplist Entry
-        Passed in the buffer, c, containing a string of bytes
-        First byte is the length of the previous item
-        Advance pointer, check value to match one of 9 conditions
+        Ziplist entries start with the length of the previous entry, 1 byte or 0xFE and 4 more
+        Next byte is the encoding, check value to match one of 9 conditions
         00------ : String, size = remaining 6 bits
         01------ : String, size = remaining 6 bits combined with next byte to make 14 bits
         10------ : String, size = next 4 bytes in big endian
@@ -128,122 +680,323 @@ static char* get_zl_entry(char *c, unsigned long *offset){
         11111110 : Int, next 1 byte makes a signed  8 bit int
         11110001 -> 11111101 : Current byte used to extract a 4 bit int (subtract 1 to get true value)
     */
-    char *entry = NULL;
-    if((unsigned char)c[0] == 254){
-        c+=4;
-        *offset+=4; 
-    }
-    c++;
-    *offset += 1;
-    if((unsigned char)c[0] >= 0 && (unsigned char)c[0] < 64){
-        uint8_t slen = 0;
-        slen |= (c[0] & MASK);
-        debug_print("DEBUG: get_zl_entry\n\t1: %.2X -> %" PRIu8 "\n",c[0],slen);
-        if(slen > 0){
-            entry = malloc(sizeof(char)*slen+SPACE_FOR_NULL);
-            if(entry == NULL){
-                debug_print("ERROR: Could not malloc space for %" PRIu8 " bytes\n",slen);
-                return NULL;
-            }
-            memset(entry,'\0',slen+SPACE_FOR_NULL);
-            memcpy(entry,c+1,slen);
-        }
-        *offset += (slen+1);
-    } else if((unsigned char)c[0] > 63 && (unsigned char)c[0] < 128){
-        uint16_t slen = 0;
-        /* 
-            This part was a strange bug to track down so here is an explanation:
-            After decompressing, the bytes represented in the char array are potentially 
-            represented as 0xFFFFFF80 instead of just the last two bytes (80 in this example).
-            This caused a problem with the above because it would do slen |= 0xFFFFFF00 and 
-            not slen |= 0x80 as expected. Then the length would become something absurd
-            and cause a seg fault. So I just mask the beginning to be zeros which would have 
-            no effect on an already proper byte representation.
-        */
-        slen |= ((c[0] & MASK) << 8u); 
-        slen |= (c[1] & 0x000000FF);
-        debug_print("DEBUG: get_zl_entry\n\t2: %.2X %.2X -> %" PRIu16 "\n",c[0],c[1],slen);
-        entry = malloc(sizeof(char)*slen+SPACE_FOR_NULL);
-        if(entry == NULL){
-            debug_print("ERROR: Could not malloc space for %" PRIu16 " bytes\n",slen);
-            return NULL;
+    const unsigned char *c;
+    unsigned long room, hdr, slen;
+    int16_t i16;
+    int32_t i32;
+    int64_t i64;
+    e->str = NULL;
+    e->len = 0;
+    e->num = 0;
+    if(it->enc){
+        if(it->left == 0 || it->len - it->off < it->enc)
+            return 0;
+        c = it->buf + it->off;
+        if(it->enc == 2){
+            memcpy(&i16,c,2);
+            e->num = i16;
+        } else if(it->enc == 4){
+            memcpy(&i32,c,4);
+            e->num = i32;
+        } else {
+            memcpy(&i64,c,8);
+            e->num = i64;
         }
-        memcpy(entry,c+2,slen);
-        entry[slen] = '\0';
-        *offset += (2+slen);
-    } else if((unsigned char)c[0] > 127 && (unsigned char)c[0] < 192){
-        uint32_t val = 0, slen = 0;
-        memcpy(&val,c+1,4);
-        /* Endian swap */
-        slen =  ((val & 0x000000ff) << 24u) |
-                ((val & 0x0000ff00) <<  8u) |
-                ((val & 0x00ff0000) >>  8u) |
-                ((val & 0xff000000) >> 24u) ;
-        debug_print("DEBUG: get_zl_entry\n\t3: %.2X -> %X %" PRIu32 "\n",c[0],val,slen);
-        entry = malloc(sizeof(char)*slen+SPACE_FOR_NULL);
-        if(entry == NULL){
-            debug_print("ERROR: Could not malloc space for %" PRIu32 " bytes\n",slen);
-            return NULL;
+        it->off += it->enc;
+        it->left--;
+        return 1;
+    }
+    if(it->off >= it->len || it->buf[it->off] == 0xFF)
+        return 0;
+    hdr = it->buf[it->off] == 254 ? 5 : 1;
+    if(it->len - it->off < hdr + 1)
+        return 0;
+    c = it->buf + it->off + hdr;
+    room = it->len - it->off - hdr;
+    if(c[0] < 192){
+        /* String entries point straight into the ziplist */
+        if(c[0] < 64){
+            slen = c[0] & MASK;
+            hdr += 1;
+        } else if(c[0] < 128){
+            if(room < 2)
+                return 0;
+            slen = ((c[0] & MASK) << 8u) | c[1];
+            hdr += 2;
+        } else {
+            if(room < 5)
+                return 0;
+            slen = ((unsigned long)c[1] << 24u) | (c[2] << 16u) | (c[3] << 8u) | c[4];
+            hdr += 5;
         }
-        memcpy(entry,c+5,slen);
-        entry[slen] = '\0';
-        *offset += (5+slen);
-    } else if((unsigned char)c[0] > 191 && (unsigned char)c[0] < 208){
-        int16_t i = 0;
-        memcpy(&i,c+1,2);
-        debug_print("DEBUG: get_zl_entry\n\t4: %.2X -> %" PRId16 "\n",c[0],i);
-        entry = malloc(sizeof(char)*5+SPACE_FOR_NULL);
-        memset(entry,'\0',5+SPACE_FOR_NULL);
-        sprintf(entry,"%" PRId16,i);
-        *offset += 3;
-    } else if((unsigned char)c[0] > 207 && (unsigned char)c[0] < 224){
-        int32_t i = 0;
-        memcpy(&i,c+1,4);
-        debug_print("DEBUG: get_zl_entry\n\t5: %.2X -> %" PRId32 "\n",c[0],i);
-        entry = malloc(sizeof(char)*11+SPACE_FOR_NULL);
-        memset(entry,'\0',12);
-        sprintf(entry,"%" PRId32,i);
-        *offset += 5;
-    } else if((unsigned char)c[0] > 223 && (unsigned char)c[0] < 240){
-        int64_t i = 0;
-        memcpy(&i,c+1,8);
-        debug_print("DEBUG: get_zl_entry\n\t6: %.2X -> %" PRId64 "\n",c[0],i);
-        entry = malloc(sizeof(char)*20+SPACE_FOR_NULL);
-        memset(entry,'\0',21);
-        sprintf(entry,"%" PRId64,i);
-        *offset += 9;
-    } else if((unsigned char)c[0] > 240 && (unsigned char)c[0] < 254){
-        uint8_t i = (c[0] & 0x0F) - 1;
-        debug_print("DEBUG: get_zl_entry\n\t7: %.2X -> %" PRIu8 "\n",c[0],i);
-        entry = malloc(sizeof(char)*3+SPACE_FOR_NULL);
-        memset(entry,'\0',4);
-        sprintf(entry,"%" PRIu8,i);
-        *offset += 1;
-    } else if((unsigned char)c[0] == 240){
-        int32_t int24 = 0;
-        memcpy(&int24,c+1,3);
-        debug_print("DEBUG: get_zl_entry\n\t8: %.2X -> %" PRId32 "\n",c[0],int24);
-        entry = malloc(sizeof(char)*11+SPACE_FOR_NULL);
-        memset(entry,'\0',12);
-        sprintf(entry,"%" PRId32,int24);
-        *offset += 4;
-    } else if((unsigned char)c[0] == 254){
-        int8_t int8 = 0;
-        memcpy(&int8,c+1,1);
-        debug_print("DEBUG: get_zl_entry\n\t9: %.2X -> %" PRId8 "\n",c[0],int8);
-        entry = malloc(sizeof(char)*3+SPACE_FOR_NULL);
-        memset(entry,'\0',4);
-        sprintf(entry,"%" PRId8,int8);
-        *offset += 2;
-    }
-    return entry;
-}
-
-static int load_compressed(unsigned char *c, unsigned int clen, FILE *fd){
-    return fread(c,1,clen,fd);
-}
-
-static unsigned long long get_length(unsigned char *buffer, FILE *fd){
+        if(it->len - it->off - hdr < slen)
+            return 0;
+        e->str = (const char*)it->buf + it->off + hdr;
+        e->len = slen;
+        it->off += hdr + slen;
+        debug_print("DEBUG: zi_next string of %lu bytes\n",slen);
+        return 1;
+    }
+    if(c[0] < 208){
+        if(room < 3)
+            return 0;
+        memcpy(&i16,c+1,2);
+        e->num = i16;
+        hdr += 3;
+    } else if(c[0] < 224){
+        if(room < 5)
+            return 0;
+        memcpy(&i32,c+1,4);
+        e->num = i32;
+        hdr += 5;
+    } else if(c[0] < 240){
+        if(room < 9)
+            return 0;
+        memcpy(&i64,c+1,8);
+        e->num = i64;
+        hdr += 9;
+    } else if(c[0] == 240){
+        if(room < 4)
+            return 0;
+        /* Sign extend the 24 bits */
+        e->num = (int32_t)(((uint32_t)c[1] << 8u) | ((uint32_t)c[2] << 16u) | ((uint32_t)c[3] << 24u)) >> 8;
+        hdr += 4;
+    } else if(c[0] == 254){
+        if(room < 2)
+            return 0;
+        e->num = (int8_t)c[1];
+        hdr += 2;
+    } else if(c[0] < 254){
+        e->num = (c[0] & 0x0F) - 1;
+        hdr += 1;
+    } else {
+        return 0;
+    }
+    debug_print("DEBUG: zi_next integer %" PRId64 "\n",e->num);
+    it->off += hdr;
+    return 1;
+}
+
+static int i64toa(char *dst, int64_t v){
+    if(v < 0){
+        dst[0] = '-';
+        return 1 + ow_utoa(dst+1,-(uint64_t)v);
+    }
+    return ow_utoa(dst,v);
+}
+
+/* Append an entry to a value being built, integers get their text here */
+static void ki_cat_ze(struct KI *key, struct ZE *e){
+    char num[20];
+    if(e->str != NULL)
+        ki_cat(key,e->str,e->len);
+    else
+        ki_cat(key,num,i64toa(num,e->num));
+}
+
+/*
+    LJ : LZF Job, a compressed string handed to the pool
+        in   = compressed bytes, in the mapping, the key arena or after out
+        clen = compressed length
+        out  = the KI's str, ulen + 1 bytes out of the key arena or after the job
+        ulen = decompressed length
+        got  = what lzf_decompress_fast() returned
+        done = a pool thread is finished with it
+        own  = bytes of the malloc'd block an lz_own() job and its buffers are in, lz_free()
+               frees it. 0 for lz_submit() jobs
+        next = next job in the queue
+    LZ : LZF Pool
+        Threads that do nothing but decompress. Only strings of LZ_MIN or more are worth
+        the hand off. Jobs from lz_submit() and their buffers live in the submitting
+        thread's arena, so every one has to be waited on before that thread's ar_reset().
+        Jobs from lz_own() don't, a --pipeline string value is one and it goes over to the
+        formatter in its KR. The parser carries on with the following keys while it is
+        decompressed, until LZ_AHEAD bytes of them are waiting.
+        ahead = bytes of lz_own() jobs not freed yet
+        defer = str_enc() may hand compressed strings to the pool, only set while a caller
+            that waits on them is reading
+        own   = same for a string value the formatter will wait on
+*/
+#define LZ_MIN              (4 << 10)
+#define LZ_AHEAD            (256UL << 20)
+
+struct LJ {
+    const unsigned char *in;
+    unsigned int clen;
+    char *out;
+    unsigned int ulen;
+    unsigned int got;
+    int done;
+    size_t own;
+    struct LJ *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t fin;
+    struct LJ *head;
+    struct LJ *tail;
+    pthread_t *tid;
+    int n;
+    int stop;
+    atomic_ulong ahead;
+} lz = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+__thread struct {
+    unsigned int defer : 1;
+    unsigned int own : 1;
+} lzq;
+
+static void* lz_thread(void *arg){
+    struct LJ *j;
+    unsigned int got;
+    pthread_mutex_lock(&lz.lock);
+    while(1){
+        while(lz.head == NULL && !lz.stop)
+            pthread_cond_wait(&lz.work,&lz.lock);
+        if(lz.head == NULL)
+            break;
+        j = lz.head;
+        lz.head = j->next;
+        if(lz.head == NULL)
+            lz.tail = NULL;
+        pthread_mutex_unlock(&lz.lock);
+        got = pf_lzf(j->in,j->clen,j->out,j->ulen);
+        pthread_mutex_lock(&lz.lock);
+        j->got = got;
+        j->done = 1;
+        pthread_cond_broadcast(&lz.fin);
+    }
+    pthread_mutex_unlock(&lz.lock);
+    if(args.profile)
+        pf_flush();
+    return NULL;
+}
+
+/* Start n pool threads, as many as could be started are used */
+static int lz_start(int n){
+    lz.tid = calloc(n,sizeof(pthread_t));
+    if(lz.tid == NULL)
+        return -1;
+    for(lz.n = 0; lz.n < n; lz.n++)
+        if(pthread_create(&lz.tid[lz.n],NULL,lz_thread,NULL) != 0)
+            break;
+    return lz.n > 0 ? 0 : -1;
+}
+
+static void lz_stop(){
+    int i;
+    pthread_mutex_lock(&lz.lock);
+    lz.stop = 1;
+    pthread_cond_broadcast(&lz.work);
+    pthread_mutex_unlock(&lz.lock);
+    for(i=0;i<lz.n;i++)
+        pthread_join(lz.tid[i],NULL);
+    free(lz.tid);
+    lz.tid = NULL;
+    lz.n = 0;
+}
+
+static void lz_queue(struct LJ *j){
+    pthread_mutex_lock(&lz.lock);
+    if(lz.tail != NULL)
+        lz.tail->next = j;
+    else
+        lz.head = j;
+    lz.tail = j;
+    pthread_cond_signal(&lz.work);
+    pthread_mutex_unlock(&lz.lock);
+}
+
+/* Queue a decompression, NULL means the caller should just do it inline */
+static struct LJ* lz_submit(const unsigned char *in, unsigned int clen, char *out, unsigned int ulen){
+    struct LJ *j;
+    if(!lzq.defer || lz.n == 0 || ulen < LZ_MIN)
+        return NULL;
+    j = ar_alloc(sizeof(struct LJ));
+    if(j == NULL)
+        return NULL;
+    j->in = in;
+    j->clen = clen;
+    j->out = out;
+    j->ulen = ulen;
+    j->got = 0;
+    j->done = 0;
+    j->own = 0;
+    j->next = NULL;
+    lz_queue(j);
+    return j;
+}
+
+/*
+    Queue a decompression that outlives the key, with the output buffer and, when in isn't
+    in the mapping, a copy of it in the job's own block. NULL means do it inline.
+*/
+static struct LJ* lz_own(const unsigned char *in, unsigned int clen, unsigned int ulen, int copy){
+    struct LJ *j;
+    size_t n = sizeof(struct LJ) + ulen + SPACE_FOR_NULL + (copy ? clen : 0);
+    if(lz.n == 0 || ulen < LZ_MIN)
+        return NULL;
+    if(atomic_fetch_add_explicit(&lz.ahead,n,memory_order_relaxed) + n > LZ_AHEAD ||
+            (j = malloc(n)) == NULL){
+        atomic_fetch_sub_explicit(&lz.ahead,n,memory_order_relaxed);
+        return NULL;
+    }
+    j->out = (char*)(j + 1);
+    memset(j->out,'\0',ulen + SPACE_FOR_NULL);
+    if(copy){
+        memcpy(j->out + ulen + SPACE_FOR_NULL,in,clen);
+        in = (unsigned char*)j->out + ulen + SPACE_FOR_NULL;
+    }
+    j->in = in;
+    j->clen = clen;
+    j->ulen = ulen;
+    j->got = 0;
+    j->done = 0;
+    j->own = n;
+    j->next = NULL;
+    lz_queue(j);
+    return j;
+}
+
+/* Block until a job is done */
+static void lz_wait(struct LJ *j){
+    pthread_mutex_lock(&lz.lock);
+    while(!j->done)
+        pthread_cond_wait(&lz.fin,&lz.lock);
+    pthread_mutex_unlock(&lz.lock);
+    if(j->got == 0){
+        /* Error decompressing string */
+        fprintf(stderr,"ERROR : Couldn't decompress string\n");
+    }
+}
+
+/* Done with an lz_own() job, waits for it first */
+static void lz_free(struct LJ *j){
+    size_t n = j->own;
+    pthread_mutex_lock(&lz.lock);
+    while(!j->done)
+        pthread_cond_wait(&lz.fin,&lz.lock);
+    pthread_mutex_unlock(&lz.lock);
+    free(j);
+    atomic_fetch_sub_explicit(&lz.ahead,n,memory_order_relaxed);
+}
+
+/* Block until the key's string is decompressed */
+static void ki_wait(struct KI *key){
+    struct LJ *j = key->job;
+    if(j == NULL)
+        return;
+    lz_wait(j);
+    key->job = NULL;
+}
+
+static int load_compressed(unsigned char *c, unsigned int clen, struct RR *fd){
+    return rr_read(fd,c,clen);
+}
+
+static unsigned long long get_length(unsigned char *buffer, struct RR *fd){
     unsigned int val = 0;
     unsigned long len = 0;
     /*  Everything uses Redis length encoding:
@@ -254,7 +1007,7 @@ static unsigned long long get_length(unsigned char *buffer, FILE *fd){
     */
     if (buffer[0] == 0x80) {
         debug_print("get_length() case 80\n");
-        fread(&val,1,4,fd);
+        rr_read(fd,&val,4);
         len |= (val & 0x000000ff) << 24u;
         len |= (val & 0x0000ff00) << 8u;
         len |= (val & 0x00ff0000) >> 8u;
@@ -264,7 +1017,7 @@ static unsigned long long get_length(unsigned char *buffer, FILE *fd){
         debug_print("get_length() case 81\n");
         unsigned long long dlen = 0;
         unsigned long long dval = 0;
-        fread(&dval,1,8,fd);
+        rr_read(fd,&dval,8);
         dlen |= (dval & 0x00000000000000ff) << 56u;
         dlen |= (dval & 0x000000000000ff00) << 40u;
         dlen |= (dval & 0x0000000000ff0000) << 24u;
@@ -283,7 +1036,7 @@ static unsigned long long get_length(unsigned char *buffer, FILE *fd){
                 return len;
             case 0x40:
                 debug_print("get_length() case 40\n");
-                fread(buffer+1,1,1,fd);
+                rr_read(fd,buffer+1,1);
                 /* 
                    buffer[0] = 00111111 
                    buffer[1] = 11111111
@@ -294,7 +1047,7 @@ static unsigned long long get_length(unsigned char *buffer, FILE *fd){
                 return len;
             case 0x80:
                 debug_print("get_length() case 80\n");
-                fread(&val,1,4,fd);
+                rr_read(fd,&val,4);
                 len |= (val & 0x000000ff) << 24u;
                 len |= (val & 0x0000ff00) << 8u;
                 len |= (val & 0x00ff0000) >> 8u;
@@ -310,9 +1063,159 @@ static unsigned long long get_length(unsigned char *buffer, FILE *fd){
     }
 }
 
+/*
+    Skip Functions
+    Walk a value using nothing but its length headers. Payloads are jumped over without
+    being copied, decompressed or allocated. These mirror the framing of the matching
+    *_enc() functions exactly, so a reader left after skip_value() is where the encoder
+    would have left it.
+*/
+
+static unsigned long long str_size(struct RR *fd){
+    /* Same framing as str_enc(), returns the size str_enc() would have reported */
+    unsigned long long size, clen;
+    unsigned char buffer[BUFFERSIZE];
+    if(rr_read(fd,buffer,1) != 1)
+        return 0;
+    size = get_length(buffer,fd);
+    if(size != 0){
+        rr_skip(fd,size);
+        return size + STR_OH;
+    }
+    switch(buffer[0] & MASK){
+        case 0:
+            if(buffer[0] == 0x00)
+                return 0;
+            rr_skip(fd,1);
+            return 1;
+        case 1:
+            rr_skip(fd,2);
+            return 2;
+        case 2:
+            rr_skip(fd,4);
+            return 4;
+        case 3:
+            rr_read(fd,buffer,1);
+            clen = get_length(buffer,fd);
+            rr_read(fd,buffer,1);
+            size = get_length(buffer,fd);
+            rr_skip(fd,clen);
+            return size;
+    }
+    return 0;
+}
+
+/*
+    str_size() that also hands back the first n bytes of the string in hdr, zero filled
+    past its end. A compressed string only has those n bytes decompressed, enough for a
+    ziplist or intset header without paying for the rest.
+*/
+#define HEAD_MAX            16
+
+static unsigned long long str_head(struct RR *fd, unsigned char *hdr, unsigned int n){
+    unsigned long long size, clen, m;
+    unsigned char buffer[BUFFERSIZE], in[2*HEAD_MAX+3];
+    const unsigned char *c;
+    memset(hdr,0,n);
+    if(rr_read(fd,buffer,1) != 1)
+        return 0;
+    size = get_length(buffer,fd);
+    if(size != 0){
+        m = size < n ? size : n;
+        rr_read(fd,hdr,m);
+        rr_skip(fd,size-m);
+        return size + STR_OH;
+    }
+    /* Integers have nothing to put in the header */
+    switch(buffer[0] & MASK){
+        case 0:
+            if(buffer[0] == 0x00)
+                return 0;
+            rr_skip(fd,1);
+            return 1;
+        case 1:
+            rr_skip(fd,2);
+            return 2;
+        case 2:
+            rr_skip(fd,4);
+            return 4;
+        case 3:
+            break;
+        default:
+            return 0;
+    }
+    rr_read(fd,buffer,1);
+    clen = get_length(buffer,fd);
+    rr_read(fd,buffer,1);
+    size = get_length(buffer,fd);
+    if(rr_mapped(fd)){
+        c = rr_ptr(fd,clen);
+        if(c != NULL)
+            pf_head(c,clen,hdr,n);
+    } else {
+        /* Every output byte costs at most two input bytes, read that many and skip the rest */
+        m = clen < 2*n+3 ? clen : 2*n+3;
+        if(rr_read(fd,in,m) == m)
+            pf_head(in,m,hdr,n);
+        rr_skip(fd,clen-m);
+    }
+    return size;
+}
+
+/* zllen out of a ziplist header */
+static unsigned long zl_len(const unsigned char *zl){
+    return zl[8] | (zl[9] << 8u);
+}
+
+static int skip_value(uint8_t type, struct RR *fd){
+    unsigned char buffer[BUFFERSIZE];
+    unsigned long long i, num;
+    switch(type){
+        case 0: case 9: case 10: case 11: case 12: case 13:
+            str_size(fd);
+            break;
+        case 1: case 2: case 14:
+            rr_read(fd,buffer,1);
+            num = get_length(buffer,fd);
+            for(i=0;i<num;i++)
+                str_size(fd);
+            break;
+        case 3:
+            rr_read(fd,buffer,1);
+            num = get_length(buffer,fd);
+            for(i=0;i<num;i++){
+                str_size(fd);
+                rr_read(fd,buffer,1);
+                if(buffer[0] < 253)
+                    rr_skip(fd,buffer[0]);
+            }
+            break;
+        case 4:
+            rr_read(fd,buffer,1);
+            num = get_length(buffer,fd);
+            for(i=0;i<num;i++){
+                str_size(fd);
+                str_size(fd);
+            }
+            break;
+        case 5:
+            rr_read(fd,buffer,1);
+            num = get_length(buffer,fd);
+            for(i=0;i<num;i++){
+                str_size(fd);
+                rr_skip(fd,8);
+            }
+            break;
+        default:
+            /* Modules and anything unknown can't be walked without decoding */
+            return -1;
+    }
+    return rr_error(fd) ? -1 : 0;
+}
+
 /*  Begin Encoding Functions  */
 
-static struct KI* str_enc(FILE *fd){
+static struct KI* str_enc(struct RR *fd){
     int8_t x = 0;
     int16_t y = 0;
     int32_t z = 0;
@@ -324,10 +1227,9 @@ static struct KI* str_enc(FILE *fd){
     if(key == NULL)
         return NULL;
     memset(buffer,0x00,BUFFERSIZE);
-    fread(buffer,1,1,fd);
-    if(ferror(fd)){
+    rr_read(fd,buffer,1);
+    if(rr_error(fd)){
         fprintf(stderr,"ERROR : Failed to read byte to obtain length\n");
-        free(key);
         return NULL;
     }
     key->size = get_length(buffer,fd);
@@ -347,16 +1249,16 @@ static struct KI* str_enc(FILE *fd){
                 */
                 debug_print("DEBUG: str_enc\tcase 0\n");
                 if(buffer[0] == 0x00){
-                    if(args.full || aux.x){
-                        key->str = malloc(sizeof(char));
+                    if(args.full || aux.x || aux.name){
+                        key->str = ar_alloc(sizeof(char));
                         key->str[0] = '\0';
                     }
                 } else {
-                    fread(&x,1,1,fd);
-                    if(args.full || aux.x){ 
-                        key->str = malloc(maxint);
-                        memset(key->str,'\0',maxint);
-                        sprintf(key->str,"%d",x);
+                    rr_read(fd,&x,1);
+                    if(args.full || aux.x || aux.name){ 
+                        key->str = ar_alloc(maxint+SPACE_FOR_NULL);
+                        memset(key->str,'\0',maxint+SPACE_FOR_NULL);
+                        key->len = i64toa(key->str,x);
                     }
                     key->size = 1;
                 }
@@ -366,11 +1268,11 @@ static struct KI* str_enc(FILE *fd){
             case 1:
                 /* 16 bit int */
                 debug_print("DEBUG: str_enc\tcase 1\n");
-                fread(&y,1,2,fd);
-                if(args.full || aux.x){
-                    key->str = malloc(maxint);
-                    memset(key->str,'\0',maxint);
-                    sprintf(key->str,"%d",y);
+                rr_read(fd,&y,2);
+                if(args.full || aux.x || aux.name){
+                    key->str = ar_alloc(maxint+SPACE_FOR_NULL);
+                    memset(key->str,'\0',maxint+SPACE_FOR_NULL);
+                    key->len = i64toa(key->str,y);
                     debug_print("DEBUG: str_enc\tvalue: %s\n",key->str);
                 }
                 key->size = 2;
@@ -378,11 +1280,11 @@ static struct KI* str_enc(FILE *fd){
             case 2:
                 /* 32 bit int */
                 debug_print("DEBUG: str_enc\tcase 2\n");
-                fread(&z,1,4,fd);
-                if(args.full || aux.x){ 
-                    key->str = malloc(maxint);
-                    memset(key->str,'\0',maxint);
-                    sprintf(key->str,"%d",z);
+                rr_read(fd,&z,4);
+                if(args.full || aux.x || aux.name){ 
+                    key->str = ar_alloc(maxint+SPACE_FOR_NULL);
+                    memset(key->str,'\0',maxint+SPACE_FOR_NULL);
+                    key->len = i64toa(key->str,z);
                     debug_print("DEBUG: str_enc\tvalue: %s\n",key->str);
                 }
                 key->size = 4;
@@ -395,52 +1297,84 @@ static struct KI* str_enc(FILE *fd){
                         size bytes are read from stream
                         decompress using lzf
                     Let's link Redis lzf_decompress function because it is easier
+                    The word at a time version in lzf_fast.c, lzf_d.c stays as the reference
                 */
                 debug_print("DEBUG: str_enc\tcase 3\n");
                 memset(buffer,0x00,BUFFERSIZE);
-                fread(buffer,1,1,fd);
+                rr_read(fd,buffer,1);
                 size = get_length(buffer,fd);
                 debug_print("DEBUG: str_enc getlength() size %llu\n",size);
-                c = malloc(sizeof(char)*size+SPACE_FOR_NULL);
-                fread(buffer,1,1,fd);
+                rr_read(fd,buffer,1);
                 unlen = get_length(buffer,fd);
                 debug_print("DEBUG: str_enc getlength() unlen %llu\n",unlen);
-                key->str = malloc(sizeof(char)*unlen+SPACE_FOR_NULL);
                 key->size = unlen;
-                memset(key->str,'\0',unlen+1);
-                if(args.full || aux.x){
-                    if(load_compressed(c,size,fd) == 0){
+                key->len = unlen;
+                /* Summary mode only needs the length, the string isn't even allocated */
+                if(args.full || aux.x || aux.name){
+                    if(rr_mapped(fd)){
+                        /* Decompress straight out of the mapping */
+                        c = rr_ptr(fd,size);
+                    } else {
+                        c = ar_alloc(sizeof(char)*size+SPACE_FOR_NULL);
+                        if(c != NULL && load_compressed(c,size,fd) == 0)
+                            c = NULL;
+                    }
+                    if(c == NULL){
                         /* Couldn't get compressed string */
                         fprintf(stderr,"ERROR : Could not get compressed string\n");
-                        free(c);
-                        free(key->str);
-                        break;
-                    }     
-                    if(lzf_decompress(c,size,key->str,unlen) == 0){
+                        return NULL;
+                    }
+                    /* A string value the pipeline's formatter waits on outlives the key */
+                    if(lzq.own && (key->job = lz_own(c,size,unlen,!rr_mapped(fd))) != NULL){
+                        key->str = key->job->out;
+                        debug_print("DEBUG: str_enc\tdecompressing %llu bytes on the pool for the formatter\n",unlen);
+                        return key;
+                    }
+                    key->str = ar_alloc(sizeof(char)*unlen+SPACE_FOR_NULL);
+                    if(key->str == NULL){
+                        fprintf(stderr,"ERROR : Could not allocate space of size %llu\n",unlen);
+                        return NULL;
+                    }
+                    memset(key->str,'\0',unlen+1);
+                    /* Big strings go to the pool when the caller is going to wait for them */
+                    if((key->job = lz_submit(c,size,key->str,unlen)) != NULL)
+                        debug_print("DEBUG: str_enc\tdecompressing %llu bytes on the pool\n",unlen);
+                    else if(pf_lzf(c,size,key->str,unlen) == 0){
                         /* Error decompressing string */
                         fprintf(stderr,"ERROR : Couldn't decompress string\n");
-                        break;
                     }
                 }
                 else {
-                    fseek(fd,size,SEEK_CUR);
+                    rr_skip(fd,size);
                 }
-                free(c);
-                if(args.full)
+                if(args.full && key->job == NULL)
                     debug_print("DEBUG: str_enc\tvalue: %s\n",key->str);
                 debug_print("DEBUG: str_enc() return\n");
                 return key;
             default:
                 debug_print("DEBUG: str_enc\tcase default\n");
-                key->str = malloc(sizeof(char)+1+SPACE_FOR_NULL);
+                key->str = ar_alloc(sizeof(char)+1+SPACE_FOR_NULL);
                 key->str[0] = ' ';
                 key->str[1] = '\0';
+                key->len = 1;
                 if(args.full)
                     debug_print("DEBUG: str_enc\tvalue: %s\n",key->str);
                 return key;
         }
+    } else if(rr_mapped(fd)){
+        /* Reference the string in place, nothing to copy */
+        key->len = key->size;
+        key->str = (char*)rr_ptr(fd,key->size);
+        key->ref = 1;
+        if(key->str == NULL){
+            fprintf(stderr,"ERROR : Failed to read %llu bytes\n",key->size);
+            return NULL;
+        }
+        key->size += STR_OH;
+        return key;
     } else {
-        key->str = malloc(sizeof(char) * key->size + SPACE_FOR_NULL);
+        key->len = key->size;
+        key->str = ar_alloc(sizeof(char) * key->size + SPACE_FOR_NULL);
         if(key->str == NULL){
             /* 
                 If space cannot be allocated we want to fast forward the location in the file
@@ -448,17 +1382,14 @@ static struct KI* str_enc(FILE *fd){
                 control grabbing incorrect data
             */
             debug_print("ERROR : Could not allocate space of size %llu\n",key->size);
-            free(key);
-            fseek(fd,key->size,SEEK_CUR);
+            rr_skip(fd,key->size);
             return NULL;
         }
         memset(key->str,'\0',key->size+1);
         if(key->size > 0)
-            fread(key->str,key->size,1,fd);
-        if(ferror(fd)){
+            rr_read(fd,key->str,key->size);
+        if(rr_error(fd)){
             fprintf(stderr,"ERROR : Failed to read %llu bytes\n",key->size);
-            free(key->str);
-            free(key);
             return NULL;
         }
         key->size += STR_OH;
@@ -470,200 +1401,266 @@ static struct KI* str_enc(FILE *fd){
     return NULL;
 }
 
-static struct KI* list_enc(FILE *fd){
+static struct KI* list_enc(struct RR *fd){
     /* 
         length encoding to determine number of strings in list
         then size of each string is found using string encoding 
     */
-    char *str = NULL;
     struct KI *tmp, *key;
+    struct AM m;
     unsigned long long i, lsize = 0;
+    int first = 1;
     unsigned char buffer[BUFFERSIZE];
     memset(buffer,0x00,BUFFERSIZE);
-    fread(buffer,1,1,fd);
+    rr_read(fd,buffer,1);
     lsize = get_length(buffer,fd);
-    key = str_enc(fd);
     debug_print("DEBUG: list_enc()\n");
-    for(i=1;i<lsize;i++){
+    key = create_KI();
+    key->count = lsize;
+    if(!args.full){
+        /* Only the size is wanted, walk the length headers and skip the payloads */
+        for(i=0;i<lsize;i++)
+            key->size += str_size(fd) + (i ? 48 : 0);
+        key->size += LIST_OH;
+        return key;
+    }
+    vs_claim(key);
+    ar_mark(&m);
+    for(i=0;i<lsize;i++){
         tmp = str_enc(fd);
-        key->size += tmp->size + 48;
-        if(args.full){
-            if(key->str == NULL){
-                key->str = malloc(sizeof(char)*key->size+SPACE_FOR_NULL);
-                memset(key->str,'\0',key->size+1);
-                memcpy(key->str,tmp->str,key->size);
-            }
-            else{
-                asprintf(&str,"%s, %s",key->str,tmp->str);
-                free(key->str);
-                key->str = str;
-                str = NULL;
-            }
+        if(tmp == NULL){
+            if(key == vs.key)
+                ar_rewind(&m);
+            continue;
         }
-        free(tmp->str);
-        free(tmp);
+        key->size += tmp->size + (i ? 48 : 0);
+        if(!first)
+            ki_cat(key,", ",2);
+        first = 0;
+        ki_cat(key,tmp->str,tmp->len);
+        if(key == vs.key)
+            ar_rewind(&m);
     }
     key->size += LIST_OH;
     return key;
 }
 
-static struct KI* set_enc(FILE *fd){
+static struct KI* set_enc(struct RR *fd){
     /* same as list */
     return list_enc(fd);
 }
 
-static struct KI* sset_enc(FILE *fd){
+static int sset_score(struct RR *fd, char *sc){
+    /*
+        Sorted set score is a one byte length followed by the score as a string
+        253, 254 and 255 stand for NaN, INF and -INF and have nothing after them
+        The text goes in sc (room for 255 bytes) if it is given, otherwise it is skipped
+        Returns the length of the text
+    */
+    unsigned char len = 0;
+    rr_read(fd,&len,1);
+    switch(len){
+        case 253: if(sc) memcpy(sc,"nan",3);  return 3;
+        case 254: if(sc) memcpy(sc,"inf",3);  return 3;
+        case 255: if(sc) memcpy(sc,"-inf",4); return 4;
+    }
+    if(sc)
+        rr_read(fd,sc,len);
+    else
+        rr_skip(fd,len);
+    return len;
+}
+
+static struct KI* sset_enc(struct RR *fd){
     /* 
         Sorted Set:
         str_enc() to get name
-        get_length() to get num of bytes to represent "score"
+        sset_score() to get the "score"
     */
-    char *str = NULL;
     struct KI *key = NULL, *ktmp = NULL;
-    unsigned char buffer[BUFFERSIZE], *bytelen = NULL;
-    unsigned long long i, num = 0, score = 0;
-    fread(buffer,1,1,fd);
+    struct AM m;
+    unsigned char buffer[BUFFERSIZE];
+    char score[256];
+    int slen, first = 1;
+    unsigned long long i, num = 0;
+    rr_read(fd,buffer,1);
     num = get_length(buffer,fd);
     key = create_KI();
+    key->count = num;
     debug_print("DEBUG: sset_enc() num : %llu\n",num);
+    if(!args.full){
+        /* Only the size is wanted, members by their length headers and scores skipped */
+        for(i=0;i<num;i++){
+            key->size += str_size(fd) + DICT_OH + (sizeof(float));
+            sset_score(fd,NULL);
+        }
+        key->size += SSET_OH;
+        return key;
+    }
+    vs_claim(key);
+    ar_mark(&m);
     for(i=0;i<num;i++){
         ktmp = str_enc(fd);
-        fread(buffer,1,1,fd);
-        score = get_length(buffer,fd);
-        debug_print("sset_enc score : %llu\n",score);
-        if(score == 253){
-        /*
-         * NaN
-         */
-        }else if(score == 254){
-        /* 
-         * INF
-         */
-        }else if(score == 255){
-        /* 
-         * -INF 
-         */
-        }else{
-            bytelen = malloc(sizeof(char)*score+SPACE_FOR_NULL);
-            memset(bytelen,'\0',score);
-            fread(bytelen,1,score,fd);
-        }
-        if(args.full){
-            if(key->str == NULL)
-                asprintf(&key->str,"%s > %llu",ktmp->str,score);
-            else{
-                asprintf(&str,"%s, %s > %llu",key->str,ktmp->str,score);
-                free(key->str);
-                key->str = str;
-                str = NULL;
-            }
+        slen = sset_score(fd,score);
+        debug_print("sset_enc score : %.*s\n",slen,score);
+        if(ktmp == NULL){
+            if(key == vs.key)
+                ar_rewind(&m);
+            continue;
         }
+        if(!first)
+            ki_cat(key,", ",2);
+        first = 0;
+        ki_cat(key,ktmp->str,ktmp->len);
+        ki_cat(key," > ",3);
+        ki_cat(key,score,slen);
         key->size += ktmp->size + DICT_OH + (sizeof(float));
-        free(bytelen);
-        free(ktmp->str);
-        free(ktmp);
-        score = 0;
+        if(key == vs.key)
+            ar_rewind(&m);
     }
     key->size += SSET_OH;
     return key;
 }
 
-static struct KI* sset64_enc(FILE *fd){
-    char *str = NULL;
+static struct KI* sset64_enc(struct RR *fd){
+    /* Sorted Set with the score stored as a binary little endian double */
     struct KI *key = NULL, *ktmp = NULL;
+    struct AM m;
     unsigned char buffer[BUFFERSIZE];
-    unsigned long long i, num = 0, score = 0;
-    fread(buffer,1,1,fd);
+    char score[32];
+    int slen, first = 1;
+    double d = 0;
+    unsigned long long i, num = 0;
+    rr_read(fd,buffer,1);
     num = get_length(buffer,fd);
     key = create_KI();
+    key->count = num;
     debug_print("DEBUG: sset_enc() num : %llu\n",num);
+    if(!args.full){
+        /* Only the size is wanted, members by their length headers and scores skipped */
+        for(i=0;i<num;i++){
+            key->size += str_size(fd) + DICT_OH + 8;
+            rr_skip(fd,8);
+        }
+        key->size += SSET_OH;
+        return key;
+    }
+    vs_claim(key);
+    ar_mark(&m);
     for(i=0;i<num;i++){
         ktmp = str_enc(fd);
-        fread(&score,1,8,fd);
-        debug_print("sset_enc score : %llu\n",score);
-        if(args.full){
-            if(key->str == NULL)
-                asprintf(&key->str,"%s > %llu",ktmp->str,score);
-            else{
-                asprintf(&str,"%s, %s > %llu",key->str,ktmp->str,score);
-                free(key->str);
-                key->str = str;
-                str = NULL;
-            }
+        rr_read(fd,&d,8);
+        slen = snprintf(score,sizeof(score),"%.17g",d);
+        debug_print("sset_enc score : %s\n",score);
+        if(ktmp == NULL){
+            if(key == vs.key)
+                ar_rewind(&m);
+            continue;
         }
+        if(!first)
+            ki_cat(key,", ",2);
+        first = 0;
+        ki_cat(key,ktmp->str,ktmp->len);
+        ki_cat(key," > ",3);
+        ki_cat(key,score,slen);
         key->size += ktmp->size + DICT_OH + 8;
-        free(ktmp->str);
-        free(ktmp);
-        score = 0;
+        if(key == vs.key)
+            ar_rewind(&m);
     }
     key->size += SSET_OH;
     return key;
 }
 
-static struct KI* hash_enc(FILE *fd){
+static struct KI* hash_enc(struct RR *fd){
     /* 
         size of hash is read using length encoding
         2 strings are read (field => value)
         Redis hashes are defined in dict
     */
     struct KI *tmp, *key = NULL;
-    char *str = NULL;
-    int rc = 0;
+    struct AM m;
     unsigned char buffer[BUFFERSIZE];
     unsigned long long i, hsize = 0;
     key = create_KI();
     memset(buffer,0x00,BUFFERSIZE);
-    fread(buffer,1,1,fd);
+    rr_read(fd,buffer,1);
     hsize = get_length(buffer,fd);  
+    key->count = hsize;
     debug_print("DEBUG: hash_enc()\n");
+    if(!args.full){
+        /* Only the size is wanted, fields and values by their length headers */
+        for(i=0;i<hsize;i++){
+            key->size += str_size(fd) + 24;
+            key->size += str_size(fd) + 24;
+        }
+        key->size += (56 + 32) * 6;
+        return key;
+    }
+    vs_claim(key);
+    ar_mark(&m);
     for(i=0;i<hsize;i++){
+        if(i)
+            ki_cat(key,", ",2);
         tmp = str_enc(fd);
-        if(tmp != NULL)
+        if(tmp != NULL){
             key->size += tmp->size + 24;
-        if(args.full){
-            if(key->str == NULL){
-                rc = asprintf(&key->str,"%s =>",tmp->str);
-            } else {
-                rc = asprintf(&str,"%s, %s =>",key->str,tmp->str);
-                free(key->str);
-                key->str = str;
-                str = NULL;
-            }
-            if(rc < 1)
-                fprintf(stderr,"ERROR : asprintf() failed\n");
+            ki_cat(key,tmp->str,tmp->len);
         }
-        rc = 0;
-        free(tmp);
+        ki_cat(key," => ",4);
         tmp = str_enc(fd);
-        if(tmp != NULL)
+        if(tmp != NULL){
             key->size += tmp->size + 24;
-        if(args.full){
-            rc = asprintf(&str,"%s %s",key->str, tmp->str);
-            if(rc < 1){
-                fprintf(stderr,"ERROR :  asprintf() failed\n");
-            }
-            free(key->str);
-            key->str = str;
+            ki_cat(key,tmp->str,tmp->len);
         }
-        str = NULL;
-        free(tmp->str);
-        free(tmp);
+        if(key == vs.key)
+            ar_rewind(&m);
     }
     /* Hash ROBJ pointer/dict overhead space */
     key->size += (56 + 32) * 6;
     return key;
 }
 
-static struct KI *mod_enc(FILE *fd){
+static struct KI *mod_enc(struct RR *fd){
     return NULL;
 }
 
-static struct KI* zm_enc(FILE *fd){
+static struct KI* zm_enc(struct RR *fd){
     /* allegedly deprecated... */
     return 0;
 }
 
-static struct KI* zl_enc(FILE *fd){
+static unsigned long zl_cat(struct KI *key, struct ZI *it, unsigned long num){
+    /*
+        Render num entries from the iterator, comma separated.
+        Stops early on the 0xFF end marker or the end of the ziplist.
+        Returns the number of entries rendered.
+    */
+    unsigned long i;
+    struct ZE e;
+    for(i=0; i<num && zi_next(it,&e); i++){
+        if(i)
+            ki_cat(key,", ",2);
+        ki_cat_ze(key,&e);
+    }
+    return i;
+}
+
+static struct KI* zl_from(struct KI *ktmp){
+    /* Render a ziplist that has already been read */
+    struct KI *key = create_KI();
+    struct ZI it;
+    if(key == NULL)
+        return NULL;
+    vs_claim(key);
+    key->size = ktmp->size;
+    debug_print("DEBUG: zl_enc() size of key = %llu\n",key->size);
+    /* zllen tops out at 65535 and then has to be counted, so just walk to the end marker */
+    zi_zl(&it,ktmp->str,ktmp->len);
+    key->count = zl_cat(key,&it,-1);
+    return key;
+}
+
+static struct KI* zl_enc(struct RR *fd){
     /*
         zlbytes: 4 byte uint of total zip list size
         zltail : 4 byte uint in LITTLE endian of offset to tail
@@ -677,259 +1674,202 @@ static struct KI* zl_enc(FILE *fd){
         parse using above format
     */
     struct KI *ktmp = NULL, *key = NULL;
-    char *tmp = NULL;
-    size_t tmpsize = 0;
-    unsigned long offset = 10, keyoff = 0;
-    ktmp = str_enc(fd);
-    key = create_KI();
-    key->size = ktmp->size;
-    debug_print("DEBUG: zl_enc() size of key = %llu\n",key->size);
-    if(args.full){
-        key->str = malloc(key->size);
-        memset(key->str,' ',key->size);
-        key->str[key->size-1] = '\0';
-        while((unsigned char)ktmp->str[offset] != 0xFF && offset < ktmp->size){
-            tmp = get_zl_entry(ktmp->str+offset,&offset);
-            debug_print("DEBUG: zl_enc() keyoff = %lu\n",keyoff);
-            if(tmp == NULL) {
-                continue;
-            }
-            /*else if(key->str == NULL){
-                asprintf(&key->str,"%s",tmp);
-            }*/
-            else{
-                #if 0
-                asprintf(&str,"%s, %s",key->str,tmp);
-                free(key->str);
-                key->str = str;
-                str = NULL;
-                #endif
-                tmpsize = strlen(tmp);
-                memcpy(key->str+keyoff,tmp,tmpsize);
-                keyoff += (unsigned)tmpsize;
-                free(tmp);
-            }
-        }
+    unsigned char hdr[10];
+    if(!args.full){
+        /* Only the size and count are wanted, skip all but the ziplist header */
+        key = create_KI();
+        key->size = str_head(fd,hdr,10);
+        key->count = zl_len(hdr);
+        return key;
     }
-    free(ktmp->str);
-    free(ktmp);
-    return key;
+    ktmp = str_enc(fd);
+    if(ktmp == NULL)
+        return NULL;
+    return zl_from(ktmp);
 }
 
-static struct KI* is_enc(FILE *fd){
+static struct KI* is_enc(struct RR *fd){
    /*
         after string encoding to get full size...
         first 4 bytes are encoding (2,4,8)
         next 4 bytes is length of contents
         contents
     */ 
-    char *str = NULL;
     struct KI *tmp = NULL, *key = NULL;
-    uint32_t num, type = 0, offset = 0;
-    unsigned long size;
+    struct ZI it;
+    unsigned char hdr[8];
+    uint32_t num;
     debug_print("DEBUG: is_enc()\n");
+    if(!args.full){
+        /* Only the size and count are wanted, skip all but the intset header */
+        key = create_KI();
+        key->size = str_head(fd,hdr,8);
+        memcpy(&num,hdr+4,4);
+        key->count = num;
+        return key;
+    }
     tmp = str_enc(fd);
     if(tmp == NULL)
         return NULL;
-    size = tmp->size;
-    memcpy(&type,tmp->str,4);
-    memcpy(&num,tmp->str+4,4);
-    offset+=8;
     key = create_KI();
-    key->size = size;
-    if(args.full){
-        while(offset < size){
-            if(type==0x2){
-                uint16_t i = 0;
-                memcpy(&i,tmp->str+offset,2);
-                if(key->str == NULL)
-                    asprintf(&key->str,"%u",i);
-                else{ 
-                    asprintf(&str,"%s, %u",key->str,i);
-                    free(key->str);
-                    key->str = str;
-                    str = NULL;
-                }
-                offset+=2;
-            } else if(type == 0x4){
-                uint32_t i = 0;
-                memcpy(&i,tmp->str+offset,4);
-                if(key->str == NULL)
-                    asprintf(&key->str,"%u",i);
-                else{
-                    asprintf(&str,"%s, %u",key->str,i);
-                    free(key->str);
-                    key->str = str;
-                    str = NULL;
-                }
-                offset+=4;
-            } else if(type == 0x8){
-                uint64_t i = 0;
-                memcpy(&i,tmp->str+offset,8);
-                if(key->str == NULL)
-                    asprintf(&key->str,"%" PRIu64 ,i);
-                else{
-                    asprintf(&key->str,"%s, %" PRIu64 ,key->str,i);
-                    free(key->str);
-                    key->str = str;
-                    str = NULL;
-                }
-                offset+=8;
-            }
-        }
-    }
-    free(tmp->str);
-    free(tmp);
+    vs_claim(key);
+    key->size = tmp->size;
+    if(zi_is(&it,tmp->str,tmp->len) == 0)
+        key->count = zl_cat(key,&it,-1);
     return key;
 }
 
-static struct KI* hmzl_enc(FILE *fd){
+static struct KI* hmzl_enc(struct RR *fd){
     /*
         Hash Map as a Ziplist
         Get entire value size using String Encoding
         Make sure the number of entries, num, is divisible by 2
         Get a Ziplist entry twice per iteration as the field =>value
     */
-    char *tmp = NULL;
-    size_t tmpsize = 0;
     struct KI *ktmp = NULL, *key = NULL;
+    struct ZI it;
+    struct ZE e;
     uint16_t i, num = 0;
     uint32_t zlbytes = 0, tail = 0;
-    unsigned long offset = 0, keyoff = 0;
+    unsigned char hdr[10];
     debug_print("DEBUG: hmzl_enc()\n");
-    ktmp = str_enc(fd);
-    if(ktmp == NULL)
-        return NULL; 
-    memcpy(&zlbytes,ktmp->str,4);
-    memcpy(&tail,ktmp->str+4,4);
-    memcpy(&num,ktmp->str+8,2);
-    offset += 10;
+    if(args.full){
+        ktmp = str_enc(fd);
+        if(ktmp == NULL)
+            return NULL; 
+        memset(hdr,0,10);
+        memcpy(hdr,ktmp->str,ktmp->len < 10 ? ktmp->len : 10);
+    } else {
+        /* Only the size and count are wanted, just the ziplist header is decompressed */
+        str_head(fd,hdr,10);
+    }
+    memcpy(&zlbytes,hdr,4);
+    memcpy(&tail,hdr+4,4);
+    memcpy(&num,hdr+8,2);
     if(num%2)
         fprintf(stderr,"ERROR : Don't make no sense\n");
     key = create_KI();
     key->size = zlbytes;
-    /* num (number of hash values) * 6 (characters for formatting like =>) */
-    key->str = malloc(key->size+(6*num)+1);
-    memset(key->str,' ',(key->size+(6*num/2)));
-    key->str[key->size+(6*num)] = '\0';
-    if(key->str == NULL){
-        debug_print("DEBUG: ERROR: hmzl_enc() Could not create space for key->str, size = %llu\n",key->size);
-        return NULL;
-    }
-    debug_print("DEBUG: hmzl_enc() key->str allocated size : %llu\n",key->size);
-    if(args.full){
-        for(i=0;i<(num/2);i++){
-            /* need to do null check before strlen! zl_entry can return NULL */
-            tmp = get_zl_entry(ktmp->str+offset,&offset);
-            if(tmp != NULL){
-                tmpsize = strlen(tmp);
-                memcpy(key->str+keyoff,tmp,tmpsize);
-                keyoff += (unsigned)tmpsize;
-                free(tmp);
-                key->str[keyoff] = ' ';
-                key->str[keyoff+1] = '=';
-                key->str[keyoff+2] = '>';
-                key->str[keyoff+3] = ' ';
-                keyoff+=4;
-            }
-            tmp = get_zl_entry(ktmp->str+offset,&offset);
-            if(tmp == NULL){
-                keyoff++;
-            }else{
-                tmpsize = strlen(tmp);
-                memcpy(key->str+keyoff,tmp,tmpsize);
-                keyoff += (unsigned)tmpsize;
-                free(tmp);
-            }
-            if(i != ((num/2) - 1)){
-                key->str[keyoff] = ',';
-                key->str[keyoff+1] = ' ';
-                keyoff+=2;
-            }
-            debug_print("DEBUG: hmzl_enc() key->str value = %s\n\tkeyoff = %lu\n",key->str,keyoff);
-        }
+    key->count = num/2;
+    if(!args.full)
+        return key;
+    vs_claim(key);
+    zi_zl(&it,ktmp->str,ktmp->len);
+    for(i=0;i<(num/2) && zi_next(&it,&e);i++){
+        if(i)
+            ki_cat(key,", ",2);
+        ki_cat_ze(key,&e);
+        ki_cat(key," => ",4);
+        if(zi_next(&it,&e))
+            ki_cat_ze(key,&e);
     }
-    free(ktmp->str);
-    free(ktmp);
+    debug_print("DEBUG: hmzl_enc() key->str value = %s\n",key->str);
     return key;
 }
 
-static struct KI* sszl_enc(FILE *fd){
+static struct KI* sszl_enc(struct RR *fd){
     /*
         Sorted Set as a Ziplist
-        Similar to hmzl above
+        Similar to hmzl above, member and score are separate entries
     */
-    char *tmp = NULL;
-    size_t tmpsize = 0;
     struct KI *key = NULL, *ktmp = NULL;
-    uint16_t i, num = 0;
-    unsigned long offset = 10, keyoff = 0;
+    struct ZI it;
+    uint16_t num = 0;
+    unsigned char hdr[10];
     debug_print("DEBUG: sszl_enc()\n");
+    if(!args.full){
+        /* Only the size and count are wanted, skip all but the ziplist header */
+        key = create_KI();
+        key->size = str_head(fd,hdr,10);
+        key->count = zl_len(hdr)/2;
+        return key;
+    }
     ktmp = str_enc(fd);
+    if(ktmp == NULL)
+        return NULL;
+    /* zllen is at 8, a blob too short for the 10 byte header is corrupt */
+    if(ktmp->str == NULL || ktmp->len < 10){
+        fprintf(stderr,"ERROR : SSZL of %lu bytes is too short for a ziplist header\n",ktmp->len);
+        return NULL;
+    }
     memcpy(&num,ktmp->str+8,2);
     if(num%2){
         fprintf(stderr,"ERROR : Odd number of entries for SSZL which should not occur!\n");
     }
     key = create_KI();
+    vs_claim(key);
     key->size = ktmp->size;
-    key->str = malloc(key->size+(num*3*8)+1);
-    /* 8 is for the size of an integer since scores are numbers those converted to ascii is going to need space */
-    memset(key->str,' ',(key->size+(num*3*8)));
-    key->str[key->size+(num*3)] = '\0';
     debug_print("DEBUG: sszl_enc() size of key = %llu\n",key->size);
-    if(args.full){
-        for(i=0;i<(num);i++){
-            tmp = get_zl_entry(ktmp->str+offset,&offset);
-            if(tmp == NULL){
-                keyoff++;
-            }else{
-                tmpsize = strlen(tmp);
-                memcpy(key->str+keyoff,tmp,tmpsize);
-                keyoff += (unsigned)tmpsize;
-            }
-            if(i != (num-1)){
-                key->str[keyoff] = ',';
-                keyoff+=2;
-            }else{
-                key->str[keyoff] = '\0';
-            } 
-            free(tmp);
-            debug_print("DEBUG: sszl_enc() key->str value = %s\n\tkeyoff = %lu\n",key->str,keyoff);
-        }
-    }
-    free(ktmp->str);
-    free(ktmp);
+    zi_zl(&it,ktmp->str,ktmp->len);
+    key->count = zl_cat(key,&it,num)/2;
     return key;
 }
 
-static struct KI* ql_enc(FILE *fd){
+static struct KI* ql_enc(struct RR *fd){
     /* 
         Quicklist is a linked list of ziplists.
         Read number of entries in list with get_length()
         Iterate over list, every entry is a ziplist.
     */
-    char *str = NULL;
-    int i;
-    struct KI *key = NULL, *ktmp;
+    unsigned long long i;
+    struct KI *key = NULL, *ktmp, **node = NULL;
+    struct AM m;
     unsigned char buffer[BUFFERSIZE];
     unsigned long long num = 0;
+    int first = 1;
     debug_print("DEBUG: ql_enc()\n");
-    fread(buffer,1,1,fd);
+    rr_read(fd,buffer,1);
     num = get_length(buffer,fd);
     key = create_KI();
+    /* A streamed value is rendered a node at a time, not read in whole first */
+    if(args.full && !args.stream && lz.n > 0 && num < UINT_MAX)
+        node = ar_alloc(sizeof(struct KI*) * num);
+    if(node != NULL){
+        /*
+            Read every node first, the big ones are decompressed on the pool while the
+            rest are read. Then render them in file order, waiting on each as it comes up.
+        */
+        lzq.defer = 1;
+        for(i = 0; i < num; i++)
+            node[i] = str_enc(fd);
+        lzq.defer = 0;
+        for(i = 0; i < num; i++){
+            if(node[i] == NULL)
+                continue;
+            ki_wait(node[i]);
+            ktmp = zl_from(node[i]);
+            if(ktmp == NULL)
+                continue;
+            if(!first)
+                ki_cat(key," | ",3);
+            first = 0;
+            ki_cat(key,ktmp->str,ktmp->len);
+            key->count += ktmp->count;
+            key->size += QI_OH;
+        }
+        key->size += QL_OH;
+        return key;
+    }
+    if(args.full)
+        vs_claim(key);
+    ar_mark(&m);
     for(i = 0; i < num; i++){
         ktmp = zl_enc(fd);
-        if(key->str == NULL){
-            asprintf(&key->str,"%s",ktmp->str);
-        } else {
-            asprintf(&str,"%s | %s",key->str,ktmp->str);
-            free(key->str);
-            key->str = str;
-            str = NULL;
+        if(ktmp == NULL){
+            if(key == vs.key)
+                ar_rewind(&m);
+            continue;
+        }
+        if(args.full){
+            if(!first)
+                ki_cat(key," | ",3);
+            first = 0;
+            ki_cat(key,ktmp->str,ktmp->len);
         }
+        key->count += ktmp->count;
         key->size += QI_OH;
-        free(ktmp->str);
-        free(ktmp);
+        if(key == vs.key)
+            ar_rewind(&m);
     }
     key->size += QL_OH;
     return key;
@@ -937,7 +1877,16 @@ static struct KI* ql_enc(FILE *fd){
 
 /*  End Encoding Functions  */
 
-void print_key_info(struct KI *name, struct KI *value, uint8_t type, unsigned long exp, FILE *fo){
+/* Type lines for print_key_info(), indexed by type */
+static const char *type_line[15] = {
+    "Type : String\n", "Type : List\n", "Type : Set\n", "Type : Sorted set\n", "Type : Hash\n",
+    NULL, NULL, NULL, NULL,
+    "Type : Zipmap\n", "Type : Ziplist\n", "Type : Intset\n", "Type : Sorted set in ziplist\n",
+    "Type : Hashmap in ziplist\n", "Type : Quicklist\n"
+};
+
+void print_key_info(struct KI *name, struct KI *value, uint8_t type, unsigned long exp, struct OW *fo){
+        const char *t;
         if(name == NULL){
             fprintf(stderr,"ERROR : Could not get key name!\n");
             return;
@@ -945,76 +1894,167 @@ void print_key_info(struct KI *name, struct KI *value, uint8_t type, unsigned lo
             fprintf(stderr,"ERROR : Could not get key value!\n");
             return;
         }
-        fprintf(fo,"Key  : %s\n",name->str);
-        switch(type){
-            case 0:  fprintf(fo,"Type : String\n"); break;
-            case 1:  fprintf(fo,"Type : List\n"); break;
-            case 2:  fprintf(fo,"Type : Set\n"); break;
-            case 3:  fprintf(fo,"Type : Sorted set\n"); break;
-            case 4:  fprintf(fo,"Type : Hash\n"); break;
-            case 9:  fprintf(fo,"Type : Zipmap\n"); break;
-            case 10: fprintf(fo,"Type : Ziplist\n"); break;
-            case 11: fprintf(fo,"Type : Intset\n"); break;
-            case 12: fprintf(fo,"Type : Sorted set in ziplist\n"); break;
-            case 13: fprintf(fo,"Type : Hashmap in ziplist\n"); break;
-            case 14: fprintf(fo,"Type : Quicklist\n"); break;
-            default: fprintf(fo,"Type : N/A\n"); 
-        }
-        fprintf(fo,"Size : %llu\n",(name->size+value->size)+ROBJ_OH); 
-        fprintf(fo,"Exp  : %lu\n",exp);
+        ow_put(fo,"Key  : ",7);
+        ow_KI(name,fo);
+        ow_putc(fo,'\n');
+        t = type < 15 ? type_line[type] : NULL;
+        ow_puts(fo,t ? t : "Type : N/A\n");
+        ow_put(fo,"Size : ",7);
+        ow_u64(fo,(name->size+value->size)+ROBJ_OH);
+        ow_put(fo,"\nExp  : ",8);
+        ow_u64(fo,exp);
+        ow_putc(fo,'\n');
         if(args.full){
-            fprintf(fo,"Value: %s\n",value->str);
+            ow_put(fo,"Value: ",7);
+            if(value == vs.key)
+                vs_print(fo);
+            else if(args.max_value > 0 && value->str != NULL && value->len > args.max_value){
+                /* Strings aren't streamed, they are whole in the arena or the mapping already */
+                ow_put(fo,value->str,args.max_value);
+                ow_put(fo," ... [truncated, ",17);
+                ow_u64(fo,value->len - args.max_value);
+                ow_put(fo," more bytes]",12);
+            }
+            else
+                ow_KI(value,fo);
+            ow_putc(fo,'\n');
         }
-        fprintf(fo,"\n");
+        ow_putc(fo,'\n');
 }
 
 int parse_args(int argc, char **argv){
-    int rc = 0;
+    int i = 3, rc = 0;
     /* 
         Parse Args
-            rdb file
-            out file
-            silent/format
+            rdb file or --batch
+            out file or out dir
+            the rdb files with --batch, up to the first option
+            silent/format and --options in any order
     */ 
-    if(argc < 3 || argc > 5){
+    if(argc < 3){
         fprintf(stderr,"ERROR : Incorrect number of arguments supplied.\n");
         print_usage;
-        rc = 1;
-    }else if(argc == 4 && argv[3][0] == 's'){
-        /* silent */
-        debug_print("DEBUG : Silent mode activated %s\n",argv[3]);
-        args.noisy = 0;
-    }else if(argc == 4 && argv[3][0] == 'f'){
-        debug_print("DEBUG : Full output format %s\n",argv[3]);
-        args.full = 1;
-    }else if(argc == 4){
-        fprintf(stderr,"ERROR : Bad third argument passed. Got %s\n",argv[3]);
-        print_usage;
-        rc = 1;
-    }else if(argc == 5){
-        if((argv[3][0] == 's' && argv[4][0] == 'f') || (argv[3][0] == 'f' && argv[4][0] == 's')){
-            args.noisy = 0;
-            args.full  = 1;
+        return 1;
+    }
+    if(strcmp(argv[1],"--batch") == 0){
+        args.batch = 1;
+        args.files = argv + 3;
+        for(; i < argc && strncmp(argv[i],"--",2) != 0 && strcmp(argv[i],"full") != 0 && strcmp(argv[i],"f") != 0 &&
+                strcmp(argv[i],"silent") != 0 && strcmp(argv[i],"s") != 0; i++)
+            args.nfiles++;
+        if(args.nfiles == 0){
+            fprintf(stderr,"ERROR : --batch needs an out dir and at least one RDB file.\n");
+            print_usage;
+            return 1;
         }
-        else{
-            fprintf(stderr,"ERROR : Bad arguments passed. Got %s %s\n",argv[3],argv[4]);
+        debug_print("DEBUG : Batch of %d files into %s\n",args.nfiles,argv[2]);
+    }
+    for(; i < argc && rc == 0; i++){
+        if(strcmp(argv[i],"--threads") == 0 && i+1 < argc){
+            args.threads = atoi(argv[++i]);
+            if(args.threads <= 0)
+                args.threads = sysconf(_SC_NPROCESSORS_ONLN);
+            debug_print("DEBUG : Parsing with %d threads\n",args.threads);
+        }else if(strcmp(argv[i],"--lzf-threads") == 0 && i+1 < argc){
+            args.lzf_threads = atoi(argv[++i]);
+            if(args.lzf_threads <= 0)
+                args.lzf_threads = sysconf(_SC_NPROCESSORS_ONLN);
+            debug_print("DEBUG : Decompressing on %d threads\n",args.lzf_threads);
+        }else if(strcmp(argv[i],"--top") == 0 && i+1 < argc && atoi(argv[i+1]) > 0){
+            args.top = atoi(argv[++i]);
+            debug_print("DEBUG : Keeping the top %u keys\n",args.top);
+        }else if(strcmp(argv[i],"--histograms") == 0 || strncmp(argv[i],"--histograms=",13) == 0){
+            debug_print("DEBUG : Histograms %s\n",argv[i]);
+            args.hist = 1;
+            if(argv[i][12] == '=')
+                args.hist_csv = argv[i]+13;
+        }else if((strcmp(argv[i],"--match") == 0 || strcmp(argv[i],"--match-re") == 0) && i+1 < argc){
+            debug_print("DEBUG : Keys matching %s %s\n",argv[i],argv[i+1]);
+            if(args.match == NULL && (args.match = create_KM()) == NULL){
+                fprintf(stderr,"ERROR : Could not allocate the key filter\n");
+                rc = 1;
+            } else if(km_add(args.match,argv[i+1],argv[i][7] == '\0') != 0){
+                fprintf(stderr,"ERROR : Bad pattern for %s %s : %s\n",argv[i],argv[i+1],args.match->err);
+                rc = 1;
+            }
+            i++;
+        }else if(strcmp(argv[i],"--progress-json") == 0 && i+1 < argc){
+            args.progress_json = argv[++i];
+            debug_print("DEBUG : Progress as JSON lines to %s\n",args.progress_json);
+        }else if(strcmp(argv[i],"--progress-ms") == 0 && i+1 < argc && atoi(argv[i+1]) > 0){
+            args.progress_ms = atoi(argv[++i]);
+            debug_print("DEBUG : Progress every %u ms\n",args.progress_ms);
+        }else if(strcmp(argv[i],"--stream-values") == 0 || strncmp(argv[i],"--stream-values=",16) == 0){
+            args.stream = 1;
+            if(argv[i][15] == '=' && (args.value_buf = strtoul(argv[i]+16,NULL,10)) == 0){
+                fprintf(stderr,"ERROR : Bad buffer size for %s\n",argv[i]);
+                rc = 1;
+            }
+            debug_print("DEBUG : Streaming values through a %lu byte buffer\n",args.value_buf);
+        }else if(strcmp(argv[i],"--max-value") == 0 && i+1 < argc && strtoul(argv[i+1],NULL,10) > 0){
+            args.max_value = strtoul(argv[++i],NULL,10);
+            args.stream = 1;
+            debug_print("DEBUG : Values cut off after %lu bytes\n",args.max_value);
+        }else if(strcmp(argv[i],"--profile") == 0){
+            debug_print("DEBUG : Profiling the parse stages\n");
+            args.profile = 1;
+        }else if(strcmp(argv[i],"--verify") == 0){
+            debug_print("DEBUG : Verifying the checksum\n");
+            args.verify = 1;
+        }else if(strcmp(argv[i],"--expiry") == 0){
+            debug_print("DEBUG : Expiry timeline\n");
+            args.expiry = 1;
+        }else if(strcmp(argv[i],"--aggregate-prefixes") == 0 ||
+                strcmp(argv[i],"--aggregate-prefixes=short") == 0){
+            debug_print("DEBUG : Aggregating key prefixes %s\n",argv[i]);
+            args.prefixes = 1;
+            args.pretty = argv[i][20] == '\0';
+        }else if(strcmp(argv[i],"--pipeline") == 0){
+            debug_print("DEBUG : Formatting and writing on their own threads\n");
+            args.pipeline = 1;
+        }else if(strcmp(argv[i],"--direct") == 0){
+            debug_print("DEBUG : Writing out file with O_DIRECT\n");
+            args.direct = 1;
+        }else if(argv[i][0] == 's'){
+            /* silent */
+            debug_print("DEBUG : Silent mode activated %s\n",argv[i]);
+            args.noisy = 0;
+        }else if(argv[i][0] == 'f'){
+            debug_print("DEBUG : Full output format %s\n",argv[i]);
+            args.full = 1;
+        }else{
+            fprintf(stderr,"ERROR : Bad argument passed. Got %s\n",argv[i]);
             print_usage;
             rc = 1;
         }
     }
+    if(rc == 0 && args.match != NULL && km_compile(args.match) != 0){
+        fprintf(stderr,"ERROR : Could not compile the --match patterns : %s\n",args.match->err);
+        rc = 1;
+    }
+    /* Nothing is written per key when aggregating, so there's no value or writer to pipeline */
+    if(args.prefixes){
+        args.full = 0;
+        args.pipeline = 0;
+    }
+    /* A batch keeps every CPU busy with a file each, unless told otherwise */
+    if(args.threads == 0)
+        args.threads = args.batch ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    if(args.batch)
+        args.pipeline = 0;
     return rc;
 }
 
-int check_magic(FILE *fd){
+int check_magic(struct RR *fd, int noisy){
     unsigned char magic[5] = {0x52,0x45,0x44,0x49,0x53};
     char buffer[BUFFERSIZE];
     int i, rc = 0;
-    fread(buffer,1,5,fd);
-    if(ferror(fd)){
+    rr_read(fd,buffer,5);
+    if(rr_error(fd)){
         fprintf(stderr,"ERROR : Failed to read 5 bytes from file to check magic!\n");
         rc = 2;
     }
-    if(args.noisy){
+    if(noisy){
         fprintf(stdout,"Check magic number ... 0x");
         for(i = 0; i < 5; i++) fprintf(stdout,"%.2x",buffer[i]);
     }
@@ -1022,23 +2062,23 @@ int check_magic(FILE *fd){
         fprintf(stdout,"%17s\n","[FAIL]");
         fprintf(stderr,"ERROR : This is not a Redis RDB file!\n");
         rc = 3;
-    } else if(args.noisy){
+    } else if(noisy){
         fprintf(stdout,"%17s\n","[OK]");
     }
     return rc;
 }
 
-int check_rdb_version(FILE *fd){
+int check_rdb_version(struct RR *fd, int noisy){
     unsigned char RDB3[4] = {0x30,0x30,0x30,0x37};
     unsigned char RDB4[4] = {0x30,0x30,0x30,0x38};
     char buffer[BUFFERSIZE];
     int i, rc = 0;
-    fread(buffer,1,4,fd);
-    if(ferror(fd)){
+    rr_read(fd,buffer,4);
+    if(rr_error(fd)){
         fprintf(stderr,"ERROR : Failed to read 4 bytes to check RDB version\n");
         rc = 2;
     }
-    if(args.noisy){
+    if(noisy){
         fprintf(stdout,"Check RDB version  ... 0x");
         for(i = 0; i < 4; i++) fprintf(stdout,"%.2x",buffer[i]);
     }
@@ -1046,94 +2086,593 @@ int check_rdb_version(FILE *fd){
         fprintf(stdout,"%19s\n","[FAIL]");
         fprintf(stderr,"ERROR : Incorrect RDB Version\n");
         rc = 3;
-    } else if(args.noisy){
+    } else if(noisy){
         fprintf(stdout,"%19s\n","[OK]");
     }
     return rc;
 }
-/* 
-    Main
-    Where the magic starts.
+/*
+    DB : Database stats
+        keys    = keys read in the db, not counting aux fields or keys --match left out
+        skipped = keys --match left out
+        ttl     = keys with an expiration
+        bytes   = estimated size of the keys, the sum of their Size lines
+        keyper  = keys per type slot, as in DS
+        hint    = keys the RESIZEDB opcode said the db has
+        hintttl = keys with an expiration it said the db has
+        resize  = a RESIZEDB opcode was seen for the db
+        top     = the --top biggest keys in the db
 */
-int main(int argc, char **argv){
-    clock_t begin, end;
-    FILE *fd = NULL, *fo = NULL;
-    int i, rc = 0;
-    long pos, sz = 0, cur = 0, per  = 0;
+struct DB {
+    uint64_t keys;
+    uint64_t skipped;
+    uint64_t ttl;
+    uint64_t bytes;
+    uint64_t keyper[11];
+    uint64_t hint;
+    uint64_t hintttl;
+    uint8_t resize : 1;
+    struct TK top;
+};
+
+/*
+    DS : Dump Stats
+        Everything accumulated while walking the keys. Parallel workers each keep their
+        own and they are merged in file order once all of them are done.
+        keycount = number of keys read, aux fields included
+        skipped  = keys left out by --match, not in keycount
+        keyper   = keys per type slot, DS_SLOT() of the type
+        big      = the largest key, or the --top biggest keys
+        bytype   = the --top biggest keys of each type byte, NULL without --top
+        dbs      = stats of each db, grown to the highest db selected when it is selected
+        ndb      = entries in dbs
+        db       = db being read
+        src      = which --batch file this is, for the top keys
+        hist     = histograms with --histograms, H_METRICS of them for each type slot
+        tl       = keys then bytes in each span of the expiry timeline with --expiry
+        tlkt     = the same by key prefix, NULL without --expiry
+        peak     = high-water mark of the key arena, memory needed by the biggest key
+        rdbtime  = value of the "ctime" aux field, base for expirations
+        kt       = prefix trie with --aggregate-prefixes, NULL otherwise
+        sum      = outcome of --verify for the summary, NULL when not checked
+        eof      = the 0xFF opcode was reached
+*/
+struct DS {
+    unsigned long keycount;
+    unsigned long skipped;
+    unsigned long keyper[11];
+    struct TK big;
+    struct TK *bytype;
+    struct DB *dbs;
+    uint32_t ndb;
+    uint64_t db;
+    uint32_t src;
+    struct LH *hist;
+    uint64_t tl[2*KT_SPANS];
+    struct KT *tlkt;
+    struct KT *kt;
+    uint64_t rdbtime;
+    size_t peak;
+    const char *sum;
+    uint8_t eof : 1;
+};
+
+static struct KI* (*fptr[13])(struct RR*) = {&str_enc, &list_enc, &set_enc, &sset_enc, 
+                                            &hash_enc, &sset64_enc, &mod_enc, &zm_enc, 
+                                            &zl_enc, &is_enc, &sszl_enc, &hmzl_enc, &ql_enc};
+
+/* fptr[i] under --profile */
+static struct KI* pf_enc(int i, struct RR *fd){
+    uint64_t t = pf_now(), pos = rr_tell(fd);
+    unsigned long n = arena.n;
+    struct KI *value = (*fptr[i])(fd);
+    pf_add(i,t,rr_tell(fd) - pos,0,n);
+    return value;
+}
+
+/* print_key_info() under --profile, in is the name and value bytes it was given */
+static void pf_print(struct KI *name, struct KI *value, uint8_t type, unsigned long exp, struct OW *fo){
+    uint64_t t = pf_now();
+    unsigned long n = arena.n;
+    print_key_info(name,value,type,exp,fo);
+    pf_add(PF_PRINT,t,(name && name->str ? name->len : 0) + (value && value->str ? value->len : 0) +
+            (value && value == vs.key ? vs.out : 0),0,n);
+}
+
+static void print_profile(){
+    int i;
+    uint64_t total = 0;
+    for(i=0;i<PF_STAGES;i++)
+        if(i != PF_LZF && i != PF_HEAD)
+            total += pf_total[i].ticks;
+#if defined(__x86_64__) || defined(__i386__)
+    fprintf(stderr,"Profile (TSC cycles, encoders include the LZF they call):\n");
+#else
+    fprintf(stderr,"Profile (nanoseconds, encoders include the LZF they call):\n");
+#endif
+    fprintf(stderr,"%-20s %12s %16s %16s %18s %12s %12s %7s\n","Stage","Calls","Bytes in","Bytes out",
+            "Time","Per call","Allocs","Share");
+    for(i=0;i<PF_STAGES;i++){
+        if(pf_total[i].calls == 0)
+            continue;
+        fprintf(stderr,"%-20s %12" PRIu64 " %16" PRIu64 " %16" PRIu64 " %18" PRIu64 " %12" PRIu64 " %12" PRIu64 " %6.2f%%\n",
+                pf_name[i],pf_total[i].calls,pf_total[i].in,pf_total[i].out,pf_total[i].ticks,
+                pf_total[i].ticks / pf_total[i].calls,pf_total[i].allocs,
+                total ? 100.0 * pf_total[i].ticks / total : 0);
+    }
+}
+
+/* Histograms kept per type slot, DS_HIST() picks one */
+#define H_SIZE              0
+#define H_COUNT             1
+#define H_TTL               2
+#define H_METRICS           3
+#define DS_HIST(ds,m,slot)  (&(ds)->hist[(m)*11 + (slot)])
+
+/*
+    Type slot of a type byte, the distribution table, histograms, per db counts and progress
+    JSON all go by it and slot_name[]. Types past 8 are shifted down by 4 and a sorted set
+    with binary scores (5) is a sorted set like any other.
+*/
+#define DS_SLOT(type)       ((type) == 5 ? 3 : (type) < 9 ? (type) : (type)-4)
+
+static const char *slot_name[11] = {
+    "String", "List", "Set", "Sorted Set", "Hash", "Zipmap", "Ziplist", "Intset",
+    "SSZL", "HMZL", "Quicklist"
+};
+
+/* Keys in dbs past this are only counted, a corrupt db number shouldn't allocate much */
+#define DS_DBS              (1 << 16)
+
+static int init_DS(struct DS *ds){
+    int i;
+    memset(ds,0,sizeof(struct DS));
+    tk_init(&ds->big,args.top ? args.top : 1);
+    if(args.top){
+        ds->bytype = calloc(15,sizeof(struct TK));
+        if(ds->bytype == NULL)
+            return -1;
+        for(i=0;i<15;i++)
+            tk_init(&ds->bytype[i],args.top);
+    }
+    if(args.hist && (ds->hist = calloc(H_METRICS*11,sizeof(struct LH))) == NULL)
+        return -1;
+    if(args.expiry && (ds->tlkt = create_KT()) == NULL)
+        return -1;
+    return 0;
+}
+
+static void free_DS(struct DS *ds){
+    uint32_t i;
+    tk_free(&ds->big);
+    if(ds->bytype != NULL)
+        for(i=0;i<15;i++)
+            tk_free(&ds->bytype[i]);
+    free(ds->bytype);
+    for(i=0;i<ds->ndb;i++)
+        tk_free(&ds->dbs[i].top);
+    free(ds->dbs);
+    free(ds->hist);
+    free_KT(ds->tlkt);
+    free_KT(ds->kt);
+}
+
+/*
+    Stats of a db, NULL past DS_DBS. It is looked up when the db is selected so the array
+    is only ever grown there, not while its keys are being read
+*/
+static struct DB* ds_db(struct DS *ds, uint64_t db){
+    struct DB *t;
+    if(db >= DS_DBS)
+        return NULL;
+    if(db >= ds->ndb){
+        t = realloc(ds->dbs,sizeof(struct DB)*(db+1));
+        if(t == NULL)
+            return NULL;
+        memset(t+ds->ndb,0,sizeof(struct DB)*(db+1-ds->ndb));
+        for(;ds->ndb<=db;ds->ndb++)
+            tk_init(&t[ds->ndb].top,args.top);
+        ds->dbs = t;
+    }
+    return &ds->dbs[db];
+}
+
+/* Count a key against the top keys, name->str is never NULL here */
+static void ds_top(struct DS *ds, struct KI *name, uint64_t size, uint64_t off, uint8_t type){
+    struct DB *d;
+    tk_add(&ds->big,size,off,name->str,name->len,type,ds->db,ds->src);
+    if(ds->bytype == NULL)
+        return;
+    tk_add(&ds->bytype[type],size,off,name->str,name->len,type,ds->db,ds->src);
+    if((d = ds_db(ds,ds->db)) != NULL)
+        tk_add(&d->top,size,off,name->str,name->len,type,ds->db,ds->src);
+}
+
+/* Count a key in the expiry timeline, overall and against its prefix */
+static void ds_expiry(struct DS *ds, struct KI *name, uint64_t size, uint8_t span){
+    ds->tl[span]++;
+    ds->tl[KT_SPANS+span] += size;
+    if(name->str != NULL)
+        kt_expire(ds->tlkt,name->str,name->len,size,span);
+}
+
+/* Count a key in its type's histograms, size is the one on its Size line and TTLs only count keys that have one */
+static void ds_hist(struct DS *ds, uint8_t type, uint64_t size, uint64_t count, int ttl, uint64_t exp){
+    int slot = DS_SLOT(type);
+    lh_add(DS_HIST(ds,H_SIZE,slot),size);
+    /* A string is one element */
+    lh_add(DS_HIST(ds,H_COUNT,slot),type == 0 ? 1 : count);
+    /* Keys that were already past their expiration at save time have 0 left */
+    if(ttl)
+        lh_add(DS_HIST(ds,H_TTL,slot),(int64_t)exp < 0 ? 0 : exp);
+}
+
+static void db_merge(struct DB *d, struct DB *w){
+    int i;
+    d->keys += w->keys;
+    d->skipped += w->skipped;
+    d->ttl += w->ttl;
+    d->bytes += w->bytes;
+    for(i=0;i<11;i++)
+        d->keyper[i] += w->keyper[i];
+    d->hint += w->hint;
+    d->hintttl += w->hintttl;
+    d->resize |= w->resize;
+    tk_merge(&d->top,&w->top);
+}
+
+/*
+    Fold a worker's stats into ds. Top keys of the same size are ranked by their offset in
+    the file, so ties go to the earliest key like a serial run.
+*/
+static void merge_DS(struct DS *ds, struct DS *w){
+    struct DB *d;
+    uint32_t i;
+    ds->keycount += w->keycount;
+    ds->skipped += w->skipped;
+    for(i=0;i<11;i++)
+        ds->keyper[i] += w->keyper[i];
+    tk_merge(&ds->big,&w->big);
+    if(ds->bytype != NULL && w->bytype != NULL)
+        for(i=0;i<15;i++)
+            tk_merge(&ds->bytype[i],&w->bytype[i]);
+    for(i=0;i<w->ndb;i++)
+        if((d = ds_db(ds,i)) != NULL)
+            db_merge(d,&w->dbs[i]);
+    if(ds->hist != NULL && w->hist != NULL)
+        for(i=0;i<H_METRICS*11;i++)
+            lh_merge(&ds->hist[i],&w->hist[i]);
+    for(i=0;i<2*KT_SPANS;i++)
+        ds->tl[i] += w->tl[i];
+    if(ds->tlkt != NULL && w->tlkt != NULL)
+        kt_merge(ds->tlkt,w->tlkt);
+    if(w->peak > ds->peak)
+        ds->peak = w->peak;
+    if(ds->kt == NULL){
+        ds->kt = w->kt;
+        w->kt = NULL;
+    } else if(w->kt != NULL){
+        kt_merge(ds->kt,w->kt);
+    }
+    ds->eof |= w->eof;
+}
+
+/*
+    Pipeline
+    With --pipeline the serial run is split over three threads. The parser walks the file
+    and copies what print_key_info() needs into KR records, a formatter thread renders
+    them into the out file's buffer, and the writer (see ow_async()) does the write(2)s.
+    Stages are joined by single producer/single consumer rings so neither side locks.
+    KR : Key Record
+        kind  = KR_KEY for a key, KR_DB for a "Database selected" line in full mode
+        type  = key type
+        nnull = name had no string, printed as (null)
+        vnull = same for the value
+        nsize/vsize = name and value sizes
+        exp   = expiration, or the DB number of a KR_DB
+        nlen/vlen = bytes of name and value in data
+        heap  = data that didn't fit in inl, freed by the formatter
+        job   = lz_own() job the value is being decompressed by, NULL for none. It isn't
+                copied into data, the formatter waits on it, prints it and frees it
+        inl   = name then value for most keys
+    PL : Pipeline ring between parser and formatter
+        slot = KR_SLOTS records
+        head = records handed over, only the parser moves it
+        tail = records formatted, only the formatter moves it
+        done = parser is finished
+*/
+#define KR_SLOTS            1024
+#define KR_INLINE           480
+#define KR_KEY              0
+#define KR_DB               1
+
+struct KR {
+    uint8_t kind;
     uint8_t type;
-    uint64_t rdbtime = 0, exp = 0;
-    struct KI* (*fptr[13])(FILE*) = {&str_enc, &list_enc, &set_enc, &sset_enc, 
-                                    &hash_enc, &sset64_enc, &mod_enc, &zm_enc, 
-                                    &zl_enc, &is_enc, &sszl_enc, &hmzl_enc, &ql_enc};
-    struct KI *name = NULL, *value = NULL, *big = NULL;
-    unsigned char buffer[BUFFERSIZE];
-    unsigned long keycount = 0, keyper[11];
-    args.noisy = 1;
-    args.full  = 0;
-    aux.x = 0;
-    rc = parse_args(argc, argv);
-    if(rc != 0) 
-        goto end;
-    fd = fopen(argv[1],"rb");
-    if(fd == NULL){
-        fprintf(stderr,"ERROR : Could not open file %s for binary read!\n",argv[1]);
-        rc = 2;
-        goto end;
+    uint8_t nnull;
+    uint8_t vnull;
+    unsigned long long nsize;
+    unsigned long long vsize;
+    uint64_t exp;
+    unsigned long nlen;
+    unsigned long vlen;
+    char *heap;
+    struct LJ *job;
+    char inl[KR_INLINE];
+};
+
+struct PL {
+    struct KR *slot;
+    _Alignas(64) atomic_ulong head;
+    _Alignas(64) atomic_ulong tail;
+    atomic_int done;
+    struct OW *fo;
+    pthread_t tid;
+};
+
+static void pl_backoff(unsigned int *spins){
+    struct timespec ts = {0, 50000};
+    if((*spins)++ < 64)
+        sched_yield();
+    else
+        nanosleep(&ts,NULL);
+}
+
+/*
+    Count a key in the prefix trie with the same numbers prefix would read back out of
+    the out file: the type from the 9th character of its Type line, the printed size and
+    the expiration as atol() sees it.
+*/
+static void prefix_key(struct KT *kt, struct KI *name, struct KI *value, uint8_t type, uint64_t exp){
+    const char *t = type < 15 ? type_line[type] : NULL;
+    if(name == NULL || value == NULL){
+        print_key_info(name,value,type,exp,NULL);
+        return;
     }
-    fo = fopen(argv[2],"w+");
-    if(fo == NULL){
-        fprintf(stderr,"ERROR ; Could not open file %s for write!\n",argv[2]);
-        rc = 2;
-        goto end;
+    kt_add(kt, name->str ? name->str : "(null)", name->str ? name->len : 6, kt_type(t ? t[8] : '/'),
+        (name->size+value->size)+ROBJ_OH, exp > LONG_MAX ? LONG_MAX : exp);
+}
+
+static void print_db(struct OW *fo, uint64_t db){
+    ow_put(fo,"Database selected: ",19);
+    ow_u64(fo,db);
+    ow_putc(fo,'\n');
+}
+
+/* Next free record, waits while the formatter is a full ring behind */
+static struct KR* pl_reserve(struct PL *pl){
+    unsigned long h = atomic_load_explicit(&pl->head,memory_order_relaxed);
+    unsigned int spins = 0;
+    while(h - atomic_load_explicit(&pl->tail,memory_order_acquire) >= KR_SLOTS)
+        pl_backoff(&spins);
+    return &pl->slot[h % KR_SLOTS];
+}
+
+static void pl_commit(struct PL *pl){
+    atomic_fetch_add_explicit(&pl->head,1,memory_order_release);
+}
+
+static void pl_db(struct PL *pl, uint64_t db){
+    struct KR *r = pl_reserve(pl);
+    r->kind = KR_DB;
+    r->exp = db;
+    r->heap = NULL;
+    pl_commit(pl);
+}
+
+/* Copy a key into the ring, its KIs go away with the arena once we return */
+static void pl_key(struct PL *pl, struct KI *name, struct KI *value, uint8_t type, uint64_t exp){
+    struct KR *r;
+    char *data;
+    unsigned long vlen;
+    if(name == NULL || value == NULL){
+        /* Nothing to write, just the error */
+        print_key_info(name,value,type,exp,NULL);
+        if(value != NULL && value->job != NULL && value->job->own)
+            lz_free(value->job);
+        return;
     }
-    if(args.noisy){
-        fprintf(stdout,"Redis RDB Dump Read\n");
-        fprintf(stdout,"RDB File : %s\n",argv[1]);
-        fprintf(stdout,"Out File : %s\n",argv[2]);
-    /* Get file size for cool progress bar */
-        fseek(fd, 0L, SEEK_END);
-        sz = ftell(fd);
-        rewind(fd);
+    vlen = (args.full && value->str != NULL) ? value->len : 0;
+    if(value->job != NULL && value->job->own)
+        vlen = 0;
+    r = pl_reserve(pl);
+    r->kind = KR_KEY;
+    r->type = type;
+    r->nnull = name->str == NULL;
+    r->vnull = value->str == NULL;
+    r->nsize = name->size;
+    r->vsize = value->size;
+    r->exp = exp;
+    r->nlen = r->nnull ? 0 : name->len;
+    r->vlen = vlen;
+    r->heap = NULL;
+    r->job = value->job != NULL && value->job->own ? value->job : NULL;
+    data = r->inl;
+    if(r->nlen + vlen > KR_INLINE){
+        r->heap = malloc(r->nlen + vlen);
+        if(r->heap == NULL){
+            fprintf(stderr,"ERROR : Could not allocate %lu bytes for the formatter\n",r->nlen + vlen);
+            r->nlen = 0;
+            r->vlen = 0;
+        }
+        data = r->heap;
     }
-    /* Look for Redis Magic Number */
-    rc = check_magic(fd);
-    if(rc != 0)
-        goto end;
-    memset(buffer,'\0',BUFFERSIZE);
-    /* Check RDB version. Currently we only support 0x30303037 */
-    rc = check_rdb_version(fd);
-    fprintf(stdout,"Redis RDB file verification complete.\nGetting Redis RDB info now...\n");
-    for(i=0; i<12; i++)
-        keyper[i] = 0;
-    memset(buffer,'\0',BUFFERSIZE);
-    big = create_KI();
-    begin = clock();
-    /*  Switch statement reads single byte to determine what it is
-            FA : AUX?? Info keys before DB selected (redis version, options, etc) 
-            FC : Expire in milliseconds
-            FD : Expire in seconds
-            FE : Select DB (we only use DB 0 so this doesn't always exist)
-            FF : EOF 
-    */
-    while(fread(buffer,1,1,fd) != 0){
-        if(feof(fd) || ferror(fd)){
-            fprintf(stderr,"ERROR : fread() failure, quitting prematurely\n");
-            rc = 2;
-            goto end;
+    if(r->nlen > 0)
+        memcpy(data,name->str,r->nlen);
+    if(r->vlen > 0)
+        memcpy(data+r->nlen,value->str,r->vlen);
+    pl_commit(pl);
+}
+
+static void* pl_thread(void *arg){
+    struct PL *pl = arg;
+    struct KR *r;
+    struct KI name, value;
+    char *data;
+    unsigned long t = 0;
+    unsigned int spins = 0;
+    memset(&name,0,sizeof(struct KI));
+    memset(&value,0,sizeof(struct KI));
+    while(1){
+        if(t == atomic_load_explicit(&pl->head,memory_order_acquire)){
+            if(atomic_load_explicit(&pl->done,memory_order_acquire) &&
+                    t == atomic_load_explicit(&pl->head,memory_order_acquire))
+                break;
+            pl_backoff(&spins);
+            continue;
         }
-        /* Progress bar because on big files it is difficult to tell if anything works */
-        if(args.noisy && DEBUG == 0){
-            pos = ftell(fd);
-            per = (100*pos)/sz;
-            if(per >= cur){
-                fprintf(stdout,"\r[");
-                for(i=0;i<(per/2);i++) fprintf(stdout,"#");
-                for(i=(per/2);i<50;i++) fprintf(stdout," ");
-                fprintf(stdout,"] %3ld%%",per);
-                fflush(stdout);
-                cur = per;
+        spins = 0;
+        r = &pl->slot[t % KR_SLOTS];
+        if(r->kind == KR_DB){
+            print_db(pl->fo,r->exp);
+        } else {
+            data = r->heap ? r->heap : r->inl;
+            name.size = r->nsize;
+            name.str = r->nnull ? NULL : data;
+            name.len = r->nlen;
+            name.ref = !r->nnull;
+            value.size = r->vsize;
+            value.str = r->vnull ? NULL : data + r->nlen;
+            value.len = r->vlen;
+            value.ref = !r->vnull;
+            if(r->job != NULL){
+                /* NUL terminated like any decompressed string, printed up to the first NUL */
+                lz_wait(r->job);
+                value.str = r->job->out;
+                value.len = r->job->ulen;
+                value.ref = 0;
             }
+            if(args.profile)
+                pf_print(&name,&value,r->type,r->exp,pl->fo);
+            else
+                print_key_info(&name,&value,r->type,r->exp,pl->fo);
+            free(r->heap);
+            if(r->job != NULL)
+                lz_free(r->job);
+        }
+        atomic_store_explicit(&pl->tail,++t,memory_order_release);
+    }
+    if(args.profile)
+        pf_flush();
+    return NULL;
+}
+
+static int pl_start(struct PL *pl, struct OW *fo){
+    memset(pl,0,sizeof(struct PL));
+    pl->fo = fo;
+    pl->slot = malloc(sizeof(struct KR)*KR_SLOTS);
+    if(pl->slot == NULL)
+        return -1;
+    if(pthread_create(&pl->tid,NULL,pl_thread,pl) != 0){
+        free(pl->slot);
+        return -1;
+    }
+    return 0;
+}
+
+/* Wait for the formatter to drain the ring */
+static void pl_stop(struct PL *pl){
+    atomic_store_explicit(&pl->done,1,memory_order_release);
+    pthread_join(pl->tid,NULL);
+    free(pl->slot);
+}
+
+/*
+    Telemetry
+    The parser threads only add to a few shared counters, a ticker thread reads them every
+    --progress-ms to draw the progress line and write --progress-json. Each parse_range()
+    counts into its own DS and hands the difference over every TM_KEYS keys or TM_BYTES
+    bytes, so threads parsing at once rarely touch the shared cache line.
+    TM : Telemetry
+        bytes  = input bytes parsed by every thread so far
+        keys   = keys parsed so far
+        keyper = keys parsed per type slot, as in the distribution table
+        total  = bytes there are to parse, 0 when streaming from a pipe
+        ms     = milliseconds between ticks
+        json   = JSON lines file, NULL for none
+        bar    = draw the progress line on stdout
+        on     = counters are being kept, a ticker is running
+        stop   = tells the ticker to print its last tick and quit
+        tid, lock, cond = the ticker and what it sleeps on between ticks
+    TL : Telemetry Last, what a parse_range() has handed over so far
+*/
+#define TM_KEYS             1024
+#define TM_BYTES            (1 << 20)
+
+static struct {
+    _Alignas(64) atomic_ulong bytes;
+    atomic_ulong keys;
+    atomic_ulong keyper[11];
+    _Alignas(64) uint64_t total;
+    unsigned int ms;
+    FILE *json;
+    uint8_t bar : 1;
+    uint8_t on : 1;
+    int stop;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} tm;
+
+struct TL {
+    uint64_t pos;
+    unsigned long keys;
+    unsigned long keyper[11];
+};
+
+static void tm_flush(struct DS *ds, uint64_t pos, struct TL *tl){
+    int i;
+    atomic_fetch_add_explicit(&tm.bytes,pos - tl->pos,memory_order_relaxed);
+    atomic_fetch_add_explicit(&tm.keys,ds->keycount - tl->keys,memory_order_relaxed);
+    for(i=0;i<11;i++)
+        if(ds->keyper[i] != tl->keyper[i])
+            atomic_fetch_add_explicit(&tm.keyper[i],ds->keyper[i] - tl->keyper[i],memory_order_relaxed);
+    tl->pos = pos;
+    tl->keys = ds->keycount;
+    memcpy(tl->keyper,ds->keyper,sizeof(tl->keyper));
+}
+
+/*
+    Parse keys until the reader runs out or the 0xFF opcode is hit.
+    Switch statement reads single byte to determine what it is
+        FA : AUX?? Info keys before DB selected (redis version, options, etc) 
+        FB : Resize DB
+        FC : Expire in milliseconds
+        FD : Expire in seconds
+        FE : Select DB (we only use DB 0 so this doesn't always exist)
+        FF : EOF 
+    Progress goes to the telemetry counters when they are on.
+    Keys go to pl when it is given, otherwise they are printed to fo here.
+    With --aggregate-prefixes they only go into the prefix trie.
+*/
+static int parse_range(struct RR *fd, struct DS *ds, struct OW *fo, struct PL *pl){
+    int rc = 0;
+    uint8_t type = 0;
+    uint64_t exp = 0, off = 0, hint, hintttl;
+    int ttl;
+    struct KI *name = NULL, *value = NULL;
+    struct DB *d;
+    struct TL tl;
+    unsigned char buffer[BUFFERSIZE];
+    memset(buffer,'\0',BUFFERSIZE);
+    tl.pos = rr_tell(fd);
+    tl.keys = ds->keycount;
+    memcpy(tl.keyper,ds->keyper,sizeof(tl.keyper));
+    if(args.prefixes && ds->kt == NULL && (ds->kt = create_KT()) == NULL){
+        fprintf(stderr,"ERROR : Could not initialize prefix trie\n");
+        return 2;
+    }
+    while(rr_read(fd,buffer,1) != 0){
+        if(rr_error(fd)){
+            fprintf(stderr,"ERROR : rr_read() failure, quitting prematurely\n");
+            rc = 2;
+            break;
         }
+        /* Where the record starts, ranks top keys of the same size */
+        off = rr_tell(fd) - 1;
+        /* On big files it is difficult to tell if anything works */
+        if(tm.on && (ds->keycount - tl.keys >= TM_KEYS || off - tl.pos >= TM_BYTES))
+            tm_flush(ds,off,&tl);
         switch(buffer[0]){
             case 0xFA:
                 /* AUX is always string type */
@@ -1142,15 +2681,22 @@ int main(int argc, char **argv){
                 type = 0;
                 break;
             case 0xFB:
-                /* Resize DB */
-                /* Not sure what this is but from what I can tell 
-                    just length encoding to get stuff and then whatever */
-                fread(buffer,1,1,fd);
-                get_length(buffer,fd);
-                fread(buffer,1,1,fd);
-                get_length(buffer,fd);
-                if(ferror(fd))
+                /* 
+                    Resize DB
+                    Sizes of the db's key and expires dicts when it was saved, which
+                    is what its keys should add up to
+                */
+                rr_read(fd,buffer,1);
+                hint = get_length(buffer,fd);
+                rr_read(fd,buffer,1);
+                hintttl = get_length(buffer,fd);
+                if(rr_error(fd))
                     fprintf(stderr,"ERROR : Failed to read bytes for DB resizing\n");
+                else if((d = ds_db(ds,ds->db)) != NULL){
+                    d->hint += hint;
+                    d->hintttl += hintttl;
+                    d->resize = 1;
+                }
                 continue;
             /* 
                 Expiration is set in 4 or 8 bytes after the 1 byte flag
@@ -1161,58 +2707,31 @@ int main(int argc, char **argv){
              */
             case 0xFC:
                 /* Next 8 bytes is expiration time */
-                fread(&exp,1,8,fd);
-                if(ferror(fd))
+                rr_read(fd,&exp,8);
+                if(rr_error(fd))
                     fprintf(stderr,"ERROR : Failed to read 8 bytes for expiration\n");
                 exp = exp/1000;
                 break;
             case 0xFD:
                 /* Next 4 bytes is expiration time */
-                fread(&exp,1,4,fd);
-                if(ferror(fd))
+                rr_read(fd,&exp,4);
+                if(rr_error(fd))
                     fprintf(stderr,"ERROR : Failed to read 4 bytes for expiration\n");
                 break;
             case 0xFE:
                 /* Following byte is the DB */
-                fread(buffer,1,1,fd);
-                if(args.full)
-                    fprintf(fo,"Database selected: %llu\n",get_length(buffer,fd));
+                rr_read(fd,buffer,1);
+                ds->db = get_length(buffer,fd);
+                /* Room for the db's stats before its keys come in */
+                ds_db(ds,ds->db);
+                if(args.full && pl != NULL)
+                    pl_db(pl,ds->db);
+                else if(args.full)
+                    print_db(fo,ds->db);
                 continue;
             case 0xFF:
                 /* End of File */
-                end = clock();
-                int ttp = (end-begin)/CLOCKS_PER_SEC;
-                int minute = 0;
-                if (ttp > 60){
-                    minute = ttp/60;
-                    ttp = ttp%60;
-                }
-                fprintf(fo,"Total number of keys: %lu\n",keycount);
-                fprintf(fo,"Largest key: %s with size %llu bytes\n",big->str,big->size);
-                if(args.noisy){
-                    fprintf(stdout,"\r[");
-                    for(i=0;i<50;i++) fprintf(stdout,"#");
-                    fprintf(stdout,"] 100%%\n");
-                    fprintf(stdout,"Time to process file: %d:%.2d\n",minute,ttp);
-                    fprintf(stdout,"Total number of keys: %lu\n",keycount);
-                    fprintf(stdout,"Distribution:\n");
-                    fprintf(stdout,"+++++++++++++++++++++++++++++++++++++++++++++++++++\n");
-                    fprintf(stdout,"+ Key Type + Number of Keys + Percentage of Total +\n");
-                    fprintf(stdout,"+  String  +  %12lu  + %11.2f%%        +\n",keyper[0],(((float)keyper[0]*100)/(float)keycount));
-                    fprintf(stdout,"+   List   +  %12lu  + %11.2f%%        +\n",keyper[1],(((float)keyper[1]*100)/(float)keycount));
-                    fprintf(stdout,"+   Set    +  %12lu  + %11.2f%%        +\n",keyper[2],(((float)keyper[2]*100)/(float)keycount));
-                    fprintf(stdout,"+Sorted Set+  %12lu  + %11.2f%%        +\n",keyper[3],(((float)keyper[3]*100)/(float)keycount));
-                    fprintf(stdout,"+   Hash   +  %12lu  + %11.2f%%        +\n",keyper[4],(((float)keyper[4]*100)/(float)keycount));
-                    fprintf(stdout,"+  Zipmap  +  %12lu  + %11.2f%%        +\n",keyper[5],(((float)keyper[5]*100)/(float)keycount));
-                    fprintf(stdout,"+ Ziplist  +  %12lu  + %11.2f%%        +\n",keyper[6],(((float)keyper[6]*100)/(float)keycount));
-                    fprintf(stdout,"+  Intset  +  %12lu  + %11.2f%%        +\n",keyper[7],(((float)keyper[7]*100)/(float)keycount));
-                    fprintf(stdout,"+   SSZL   +  %12lu  + %11.2f%%        +\n",keyper[8],(((float)keyper[8]*100)/(float)keycount));
-                    fprintf(stdout,"+   HMZL   +  %12lu  + %11.2f%%        +\n",keyper[9],(((float)keyper[9]*100)/(float)keycount));
-                    fprintf(stdout,"+Quicklist +  %12lu  + %11.2f%%        +\n",keyper[10],(((float)keyper[10]*100)/(float)keycount));
-                    fprintf(stdout,"+++++++++++++++++++++++++++++++++++++++++++++++++++\n");
-                    fprintf(stdout,"Largest key: %s with size %llu bytes\n",big->str,big->size);
-                    fprintf(stdout,"Dumpread complete.\n");
-                }
+                ds->eof = 1;
                 goto end;
             default:
                 /* Key with no expiration so this byte is the type */
@@ -1222,58 +2741,1192 @@ int main(int argc, char **argv){
         }
         /* Next byte should be type */
         if(buffer[0] == 0xFC || buffer[0] == 0xFD){
-            fread(&type,1,1,fd);
-            if(ferror(fd))
+            rr_read(fd,&type,1);
+            if(rr_error(fd))
                 fprintf(stderr,"ERROR : Failed to get byte for type\n");
         }
         if(type > 14 || type < 0) continue;
         /* Next byte sequence is the key name which is str_enc */
         memset(buffer,0x00,BUFFERSIZE);
+        aux.name = args.match != NULL;
         name = str_enc(fd);
+        aux.name = 0;
+        /* A key --match doesn't want costs nothing past its length headers */
+        if(args.match != NULL && !aux.x && name != NULL &&
+                (name->str == NULL || !km_match(args.match,name->str,name->len))){
+            if(skip_value(type,fd) != 0 || rr_error(fd)){
+                fprintf(stderr,"ERROR : Could not skip the value of a key left out by --match\n");
+                rc = 2;
+                goto end;
+            }
+            ds->skipped++;
+            if((d = ds_db(ds,ds->db)) != NULL)
+                d->skipped++;
+            ar_reset();
+            type = -1;
+            exp = 0;
+            continue;
+        }
+        /* A big compressed string can be left to the pool and the formatter, see LZ */
+        lzq.own = type == 0 && pl != NULL && args.full && !aux.x && lz.n > 0;
         if(type < 9){
-            value = (*fptr[type])(fd);
-            keyper[type]++;
+            value = args.profile ? pf_enc(type,fd) : (*fptr[type])(fd);
         } 
         else{
-            value = (*fptr[type-2])(fd);
-            keyper[type-4]++;
+            value = args.profile ? pf_enc(type-2,fd) : (*fptr[type-2])(fd);
         }
+        lzq.own = 0;
+        ds->keyper[DS_SLOT(type)]++;
         /* The value of the "ctime" key is used for base to get expiration */
-        if((name->str != NULL) && type == 0 && strncmp(name->str,"ctime",5) == 0){
-            rdbtime = strtou64(value->str);
+        if((name->str != NULL) && type == 0 && name->len >= 5 && strncmp(name->str,"ctime",5) == 0){
+            if(value->job != NULL)
+                lz_wait(value->job);
+            ds->rdbtime = strtou64(value->str,value->len);
         }
+        ttl = exp > 0;
         if(exp > 0){
-            exp = exp - rdbtime;
+            exp = exp - ds->rdbtime;
             name->size += EXP_OH;
         }
-        print_key_info(name,value, type, exp, fo);
-        if((name->size + value->size) > big->size){
-            if(name->str != NULL){
-                unsigned int sss = strlen(name->str);
-                free(big->str);
-                big->str = malloc(sss+1);
-                memcpy(big->str,name->str,sss);
-                big->str[sss] = '\0';
-                big->size = name->size + value->size;
-            }
+        if(ds->kt != NULL)
+            prefix_key(ds->kt,name,value,type,exp);
+        else if(pl != NULL)
+            pl_key(pl,name,value,type,exp);
+        else if(args.profile)
+            pf_print(name,value,type,exp,fo);
+        else
+            print_key_info(name,value, type, exp, fo);
+        if(name->str != NULL && value != NULL)
+            ds_top(ds,name,name->size + value->size,off,type);
+        if(ds->hist != NULL && value != NULL)
+            ds_hist(ds,type,name->size + value->size + ROBJ_OH,value->count,ttl,exp);
+        if(ds->tlkt != NULL && value != NULL)
+            ds_expiry(ds,name,name->size + value->size + ROBJ_OH,kt_span(exp,ttl));
+        if(!aux.x && (d = ds_db(ds,ds->db)) != NULL){
+            d->keys++;
+            d->keyper[DS_SLOT(type)]++;
+            d->ttl += ttl;
+            if(value != NULL)
+                d->bytes += name->size + value->size + ROBJ_OH;
         }
         /* 
             Free up memory to keep impact down
             Reinitialize variables for next key
         */
-        free(name->str);
-        free(name);
-        free(value->str);
-        free(value);
+        ar_reset();
         type = -1;
         exp = 0;
         aux.x = 0;
-        keycount++;
+        ds->keycount++;
+    }
+end:
+    if(tm.on)
+        tm_flush(ds,rr_tell(fd),&tl);
+    if(args.profile)
+        pf_flush();
+    /* Keep the arena's high-water mark and hand its memory back */
+    ds->peak = arena.peak;
+    ar_release();
+    return rc;
+}
+
+/*
+    Index pass for parallel mode
+    Walks the record framing with skip_value() and cuts the file into n ranges of roughly
+    equal bytes, every range starting on a record boundary. cuts[0] is the first record
+    after the header, cuts[n] is just past the 0xFF opcode. dbs[k] is the db selected at
+    cuts[k]. Aux fields are decoded since every worker needs "ctime" for expirations,
+    they are few and sit before any key.
+*/
+static int index_ranges(struct RR *fd, uint64_t *cuts, uint64_t *dbs, int n, uint64_t *rdbtime){
+    int k = 1;
+    uint8_t type;
+    uint64_t pos, db = 0, start = rr_tell(fd);
+    struct KI *name, *value;
+    unsigned char buffer[BUFFERSIZE];
+    cuts[0] = start;
+    dbs[0] = 0;
+    while(1){
+        pos = rr_tell(fd);
+        while(k < n && pos >= start + ((fd->size - start) * k)/n){
+            dbs[k] = db;
+            cuts[k++] = pos;
+        }
+        if(rr_read(fd,buffer,1) != 1)
+            break;
+        switch(buffer[0]){
+            case 0xFA:
+                aux.x = 1;
+                name = str_enc(fd);
+                value = str_enc(fd);
+                aux.x = 0;
+                if(name == NULL || value == NULL){
+                    ar_release();
+                    return -1;
+                }
+                if(name->len >= 5 && strncmp(name->str,"ctime",5) == 0)
+                    *rdbtime = strtou64(value->str,value->len);
+                /* Aux fields only come up here, the workers get their own arenas */
+                ar_release();
+                continue;
+            case 0xFB:
+                rr_read(fd,buffer,1);
+                get_length(buffer,fd);
+                rr_read(fd,buffer,1);
+                get_length(buffer,fd);
+                continue;
+            case 0xFC:
+                rr_skip(fd,8);
+                rr_read(fd,&type,1);
+                break;
+            case 0xFD:
+                rr_skip(fd,4);
+                rr_read(fd,&type,1);
+                break;
+            case 0xFE:
+                rr_read(fd,buffer,1);
+                db = get_length(buffer,fd);
+                continue;
+            case 0xFF:
+                goto done;
+            default:
+                type = buffer[0];
+                break;
+        }
+        str_size(fd);
+        if(skip_value(type,fd) != 0)
+            return -1;
+    }
+done:
+    pos = rr_tell(fd);
+    while(k <= n){
+        dbs[k] = db;
+        cuts[k++] = pos;
+    }
+    return rr_error(fd) ? -1 : 0;
+}
+
+/*
+    PW : Parallel Worker
+        fd = private reader over the shared mapping, limited to the worker's range
+        ds = worker stats, merged when all workers are done
+        fo = where the worker's output goes. The first range is first in the file so it
+             writes to the out file itself, the others to an ow_mem() writer that keeps
+             its share of PW_KEEP bytes in memory and is copied to the out file in file
+             order. A streamed run keeps one value buffer's worth per worker instead, so
+             memory stays bounded. Only what doesn't fit goes through a scratch file.
+*/
+#define PW_KEEP             (64UL << 20)
+
+struct PW {
+    pthread_t tid;
+    struct RR fd;
+    struct DS ds;
+    struct OW *fo;
+    int rc;
+};
+
+static void* parse_worker(void *arg){
+    struct PW *w = arg;
+    w->rc = parse_range(&w->fd,&w->ds,w->fo,NULL);
+    return NULL;
+}
+
+static int parse_parallel(struct RR *fd, struct DS *ds, struct OW *fo, int n){
+    int i, rc = 0;
+    uint64_t *cuts, *dbs;
+    struct PW *w;
+    cuts = malloc(sizeof(uint64_t)*(n+1));
+    dbs = malloc(sizeof(uint64_t)*(n+1));
+    w = calloc(n,sizeof(struct PW));
+    if(cuts == NULL || dbs == NULL || w == NULL){
+        fprintf(stderr,"ERROR : Could not allocate parallel workers\n");
+        rc = 2;
+        goto end;
+    }
+    if(index_ranges(fd,cuts,dbs,n,&ds->rdbtime) != 0){
+        fprintf(stderr,"ERROR : Index pass failed, can't split the file for workers\n");
+        rc = 2;
+        goto end;
+    }
+    for(i=0;i<n;i++){
+        w[i].fd = *fd;
+        w[i].fd.cur = fd->map + cuts[i];
+        w[i].fd.end = fd->map + cuts[i+1];
+        if(i == 0)
+            w[i].fo = fo;
+        else
+            w[i].fo = ow_mem(args.stream ? args.value_buf : PW_KEEP / n);
+        if(init_DS(&w[i].ds) != 0 || w[i].fo == NULL){
+            fprintf(stderr,"ERROR : Could not create worker %d\n",i);
+            rc = 2;
+            n = i + 1;
+            goto end;
+        }
+        w[i].ds.rdbtime = ds->rdbtime;
+        w[i].ds.db = dbs[i];
+        w[i].ds.src = ds->src;
+    }
+    for(i=0;i<n;i++){
+        if(pthread_create(&w[i].tid,NULL,parse_worker,&w[i]) != 0){
+            /* Out of threads, do it ourselves */
+            parse_worker(&w[i]);
+            w[i].tid = 0;
+        }
+    }
+    for(i=0;i<n;i++){
+        if(w[i].tid != 0)
+            pthread_join(w[i].tid,NULL);
+        if(w[i].rc != 0)
+            rc = w[i].rc;
+        merge_DS(ds,&w[i].ds);
+        if(i > 0 && ow_append(fo,w[i].fo) != 0){
+            fprintf(stderr,"ERROR : Could not copy output of worker %d\n",i);
+            rc = 2;
+        }
+    }
+end:
+    if(w != NULL){
+        for(i=0;i<n;i++){
+            if(i > 0 && w[i].fo != NULL)
+                ow_close(w[i].fo);
+            free_DS(&w[i].ds);
+        }
+    }
+    free(w);
+    free(cuts);
+    free(dbs);
+    return rc;
+}
+
+/* Type names for the top keys, indexed by type */
+static const char *type_name[15] = {
+    "String", "List", "Set", "Sorted set", "Hash", "Sorted set", "Module", "Module", "N/A",
+    "Zipmap", "Ziplist", "Intset", "Sorted set in ziplist", "Hashmap in ziplist", "Quicklist"
+};
+
+/* A sorted TK under a heading, to the out file or to stdout when fo is NULL */
+static void print_top(struct TK *tk, const char *head, struct OW *fo){
+    unsigned int i;
+    struct TE *e;
+    const char *t;
+    if(tk->used == 0)
+        return;
+    if(fo == NULL)
+        fputs(head,stdout);
+    else
+        ow_puts(fo,head);
+    for(i=0;i<tk->used;i++){
+        e = &tk->heap[i];
+        t = type_name[e->type];
+        if(fo == NULL){
+            fprintf(stdout,"%u. %s (%s, db %" PRIu32 "%s%s) with size %" PRIu64 " bytes\n",
+                    i+1,tk_name(tk,i),t,e->db,args.batch ? ", " : "",args.batch ? args.files[e->src] : "",e->size);
+            continue;
+        }
+        ow_u64(fo,i+1);
+        ow_put(fo,". ",2);
+        ow_puts(fo,tk_name(tk,i));
+        ow_put(fo," (",2);
+        ow_puts(fo,t);
+        ow_put(fo,", db ",5);
+        ow_u64(fo,e->db);
+        if(args.batch){
+            ow_put(fo,", ",2);
+            ow_puts(fo,args.files[e->src]);
+        }
+        ow_put(fo,") with size ",12);
+        ow_u64(fo,e->size);
+        ow_put(fo," bytes\n",7);
+    }
+}
+
+static void print_tops(struct DS *ds, struct OW *fo){
+    char head[64];
+    uint32_t i;
+    if(ds->bytype == NULL)
+        return;
+    snprintf(head,sizeof(head),"Top %u keys:\n",args.top);
+    print_top(&ds->big,head,fo);
+    for(i=0;i<15;i++){
+        snprintf(head,sizeof(head),"Top %u %s keys (type %" PRIu32 "):\n",args.top,type_name[i],i);
+        print_top(&ds->bytype[i],head,fo);
+    }
+    for(i=0;i<ds->ndb;i++){
+        snprintf(head,sizeof(head),"Top %u keys in db %" PRIu32 ":\n",args.top,i);
+        print_top(&ds->dbs[i].top,head,fo);
+    }
+}
+
+static const char *hist_name[H_METRICS] = {"size", "elements", "ttl"};
+
+static double tm_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Draw the progress line and write a JSON line for one tick, rates are since the last one */
+static void tm_tick(double secs, double dt, uint64_t bytes, uint64_t keys, uint64_t dbytes, uint64_t dkeys, int done){
+    double kps = dt > 0 ? dkeys / dt : 0, mbps = dt > 0 ? dbytes / dt / (1 << 20) : 0, eta = -1;
+    unsigned long eta_s;
+    int i, per;
+    char bar[21];
+    /* Against the average so far, a single slow key doesn't throw it off */
+    if(tm.total > 0 && bytes > 0 && secs > 0)
+        eta = done || bytes >= tm.total ? 0 : (tm.total - bytes) / (bytes / secs);
+    if(tm.bar){
+        if(tm.total > 0){
+            per = bytes >= tm.total || done ? 100 : 100 * bytes / tm.total;
+            for(i=0;i<20;i++)
+                bar[i] = i < per / 5 ? '#' : ' ';
+            bar[20] = '\0';
+            fprintf(stdout,"\r[%s] %3d%%",bar,per);
+        } else
+            fprintf(stdout,"\r[ %" PRIu64 " MB read ]",bytes >> 20);
+        fprintf(stdout,"  %" PRIu64 " keys  %.0f keys/s  %.1f MB/s",keys,kps,mbps);
+        if(eta >= 0){
+            eta_s = eta + 0.5;
+            if(eta_s >= 3600)
+                fprintf(stdout,"  ETA %lu:%.2lu:%.2lu ",eta_s / 3600,eta_s / 60 % 60,eta_s % 60);
+            else
+                fprintf(stdout,"  ETA %lu:%.2lu    ",eta_s / 60,eta_s % 60);
+        }
+        fprintf(stdout,done ? "\n" : "    ");
+        fflush(stdout);
+    }
+    if(tm.json != NULL){
+        fprintf(tm.json,"{\"elapsed\":%.3f,\"bytes\":%" PRIu64 ",\"total\":%" PRIu64 ",\"keys\":%" PRIu64
+                ",\"keys_per_sec\":%.1f,\"mb_per_sec\":%.2f,\"eta_sec\":",secs,bytes,tm.total,keys,kps,mbps);
+        if(eta >= 0)
+            fprintf(tm.json,"%.1f",eta);
+        else
+            fprintf(tm.json,"null");
+        fprintf(tm.json,",\"types\":{");
+        for(i=0;i<11;i++)
+            fprintf(tm.json,"%s\"%s\":%lu",i ? "," : "",slot_name[i],
+                    atomic_load_explicit(&tm.keyper[i],memory_order_relaxed));
+        fprintf(tm.json,"},\"done\":%s}\n",done ? "true" : "false");
+        fflush(tm.json);
+    }
+}
+
+static void* tm_thread(void *arg){
+    double begin = tm_now(), last = begin, now;
+    uint64_t bytes, keys, lbytes = 0, lkeys = 0;
+    struct timespec until;
+    int stop = 0;
+    (void)arg;
+    clock_gettime(CLOCK_MONOTONIC,&until);
+    while(!stop){
+        until.tv_sec += tm.ms / 1000;
+        until.tv_nsec += (tm.ms % 1000) * 1000000L;
+        if(until.tv_nsec >= 1000000000L){
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&tm.lock);
+        while(!tm.stop && pthread_cond_timedwait(&tm.cond,&tm.lock,&until) != ETIMEDOUT);
+        stop = tm.stop;
+        pthread_mutex_unlock(&tm.lock);
+        now = tm_now();
+        bytes = atomic_load_explicit(&tm.bytes,memory_order_relaxed);
+        keys = atomic_load_explicit(&tm.keys,memory_order_relaxed);
+        /* The last tick is over the whole run */
+        if(stop)
+            tm_tick(now - begin,now - begin,bytes,keys,bytes,keys,1);
+        else
+            tm_tick(now - begin,now - last,bytes,keys,bytes - lbytes,keys - lkeys,0);
+        last = now;
+        lbytes = bytes;
+        lkeys = keys;
+    }
+    return NULL;
+}
+
+/* Start counting and ticking when there is a progress line or JSON file to feed */
+static int tm_start(uint64_t total){
+    pthread_condattr_t ca;
+    tm.total = total;
+    if(!tm.bar && tm.json == NULL)
+        return 0;
+    pthread_mutex_init(&tm.lock,NULL);
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca,CLOCK_MONOTONIC);
+    pthread_cond_init(&tm.cond,&ca);
+    pthread_condattr_destroy(&ca);
+    tm.on = 1;
+    if(pthread_create(&tm.tid,NULL,tm_thread,NULL) != 0){
+        tm.on = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static void tm_stop(){
+    if(!tm.on)
+        return;
+    pthread_mutex_lock(&tm.lock);
+    tm.stop = 1;
+    pthread_cond_signal(&tm.cond);
+    pthread_mutex_unlock(&tm.lock);
+    pthread_join(tm.tid,NULL);
+    tm.on = 0;
+}
+
+/* Percentiles of every type's histograms, to the out file or to stdout when fo is NULL */
+static void print_hists(struct DS *ds, struct OW *fo){
+    static const char *head[H_METRICS] = {
+        "Size of keys (bytes):\n", "Elements per key:\n", "TTL of keys that have one (seconds):\n"
+    };
+    char line[192];
+    struct LH *h;
+    int m, i;
+    if(ds->hist == NULL)
+        return;
+    for(m=0;m<H_METRICS;m++){
+        snprintf(line,sizeof(line),"%s%-10s %12s %12s %12s %12s %12s %12s\n",head[m],
+                "Type","Keys","p50","p90","p99","p99.9","max");
+        if(fo == NULL)
+            fputs(line,stdout);
+        else
+            ow_puts(fo,line);
+        for(i=0;i<11;i++){
+            h = DS_HIST(ds,m,i);
+            if(h->count == 0)
+                continue;
+            snprintf(line,sizeof(line),"%-10s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+                    slot_name[i],h->count,lh_pct(h,0.5),lh_pct(h,0.9),lh_pct(h,0.99),lh_pct(h,0.999),h->max);
+            if(fo == NULL)
+                fputs(line,stdout);
+            else
+                ow_puts(fo,line);
+        }
+    }
+}
+
+/* Output for kt_walk(), fo NULL is stdout */
+static void print_line(struct OW *fo, const char *line){
+    if(fo == NULL)
+        fputs(line,stdout);
+    else
+        ow_puts(fo,line);
+}
+
+static void print_expiry_prefix(const char *prefix, struct KT *node, void *arg){
+    char line[KT_SPANS*14+16];
+    int i, n;
+    if(node->tl == NULL)
+        return;
+    n = snprintf(line,sizeof(line),"%-10s",prefix[0] ? prefix : "(none)");
+    for(i=0;i<KT_SPANS;i++)
+        n += snprintf(line+n,sizeof(line)-n," %13" PRIu64,node->tl[KT_SPANS+i]);
+    snprintf(line+n,sizeof(line)-n,"\n");
+    print_line(arg,line);
+}
+
+/*
+    Where the memory goes as keys expire: keys and bytes in each span of the timeline,
+    then the bytes by key prefix, to the out file or to stdout when fo is NULL
+*/
+static void print_expiry(struct DS *ds, struct OW *fo){
+    char line[KT_SPANS*14+16];
+    int i, n;
+    if(ds->tlkt == NULL)
+        return;
+    snprintf(line,sizeof(line),"Expiring (from the time of the dump):\n%-12s %14s %16s\n","Within","Keys","Bytes");
+    print_line(fo,line);
+    for(i=0;i<KT_SPANS;i++){
+        snprintf(line,sizeof(line),"%-12s %14" PRIu64 " %16" PRIu64 "\n",kt_span_name[i],ds->tl[i],ds->tl[KT_SPANS+i]);
+        print_line(fo,line);
+    }
+    print_line(fo,"Expiring by key prefix (bytes):\n");
+    n = snprintf(line,sizeof(line),"%-10s","Prefix");
+    for(i=0;i<KT_SPANS;i++)
+        n += snprintf(line+n,sizeof(line)-n," %13s",kt_span_name[i]);
+    snprintf(line+n,sizeof(line)-n,"\n");
+    print_line(fo,line);
+    kt_walk(ds->tlkt,print_expiry_prefix,fo);
+}
+
+/*
+    Keys, TTLs, size and types of every db that was selected, next to what its RESIZEDB
+    said it holds. Out file or stdout when fo is NULL. Headings don't start with "Key" so
+    the prefix tool doesn't take them for one.
+*/
+static void print_dbs(struct DS *ds, struct OW *fo){
+    char line[256];
+    struct DB *d;
+    uint32_t i;
+    int j, n;
+    if(ds->ndb == 0)
+        return;
+    print_line(fo,"Databases:\n");
+    for(i=0;i<ds->ndb;i++){
+        d = &ds->dbs[i];
+        if(d->keys == 0 && d->skipped == 0 && !d->resize)
+            continue;
+        n = snprintf(line,sizeof(line),"db %" PRIu32 " : %" PRIu64 " keys, %" PRIu64 " with a TTL, %" PRIu64 " bytes",
+                i,d->keys,d->ttl,d->bytes);
+        if(d->skipped > 0)
+            n += snprintf(line+n,sizeof(line)-n,", %" PRIu64 " left out by --match",d->skipped);
+        if(d->resize)
+            n += snprintf(line+n,sizeof(line)-n," (RESIZEDB : %" PRIu64 " keys, %" PRIu64 " with a TTL)",d->hint,d->hintttl);
+        snprintf(line+n,sizeof(line)-n,"\n");
+        print_line(fo,line);
+        n = 0;
+        line[0] = '\0';
+        for(j=0;j<11;j++)
+            if(d->keyper[j] > 0)
+                n += snprintf(line+n,sizeof(line)-n,"%s%s %" PRIu64,n ? ", " : "    ",slot_name[j],d->keyper[j]);
+        if(n > 0){
+            snprintf(line+n,sizeof(line)-n,"\n");
+            print_line(fo,line);
+        }
+    }
+}
+
+/*
+    A db with more keys than its RESIZEDB lost track of where a key ended, or the file is
+    damaged. Fewer is normal for versions that leave out keys already expired at save time.
+*/
+static void check_dbs(struct DS *ds, const char *path){
+    uint32_t i;
+    for(i=0;i<ds->ndb;i++)
+        if(ds->dbs[i].resize && ds->dbs[i].keys + ds->dbs[i].skipped > ds->dbs[i].hint)
+            fprintf(stderr,"WARNING : %s db %" PRIu32 " has %" PRIu64 " keys, more than the %" PRIu64 " in its RESIZEDB\n",
+                    path,i,ds->dbs[i].keys + ds->dbs[i].skipped,ds->dbs[i].hint);
+}
+
+/* Every non-empty bucket as metric,type,low,high,keys */
+static int write_hist_csv(struct DS *ds, const char *path){
+    FILE *f = fopen(path,"w");
+    struct LH *h;
+    int m, i, b;
+    if(f == NULL)
+        return -1;
+    fprintf(f,"metric,type,low,high,keys\n");
+    for(m=0;m<H_METRICS;m++){
+        for(i=0;i<11;i++){
+            h = DS_HIST(ds,m,i);
+            for(b=0;b<LH_BUCKETS;b++)
+                if(h->b[b] > 0)
+                    fprintf(f,"%s,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                            hist_name[m],slot_name[i],lh_low(b),lh_high(b),h->b[b]);
+        }
+    }
+    if(ferror(f)){
+        fclose(f);
+        return -1;
+    }
+    return fclose(f);
+}
+
+static void print_summary(struct DS *ds, struct OW *fo, int secs, int noisy){
+    int i;
+    int minute = 0;
+    const char *big = NULL;
+    uint64_t bigsize = 0;
+    if (secs > 60){
+        minute = secs/60;
+        secs = secs%60;
+    }
+    tk_sort(&ds->big);
+    if(ds->bytype != NULL)
+        for(i=0;i<15;i++)
+            tk_sort(&ds->bytype[i]);
+    for(i=0;i<ds->ndb;i++)
+        tk_sort(&ds->dbs[i].top);
+    if(ds->big.used > 0){
+        big = tk_name(&ds->big,0);
+        bigsize = ds->big.heap[0].size;
+    }
+    ow_put(fo,"Total number of keys: ",22);
+    ow_u64(fo,ds->keycount);
+    if(args.match != NULL){
+        ow_put(fo,"\nLeft out by --match: ",22);
+        ow_u64(fo,ds->skipped);
+        ow_put(fo," keys",5);
+    }
+    ow_put(fo,"\nLargest key: ",14);
+    ow_puts(fo,big);
+    ow_put(fo," with size ",11);
+    ow_u64(fo,bigsize);
+    ow_put(fo," bytes\n",7);
+    if(ds->sum != NULL){
+        ow_put(fo,"Checksum: ",10);
+        ow_puts(fo,ds->sum);
+        ow_putc(fo,'\n');
+    }
+    print_dbs(ds,fo);
+    print_tops(ds,fo);
+    print_hists(ds,fo);
+    print_expiry(ds,fo);
+    if(noisy){
+        fprintf(stdout,"Time to process file: %d:%.2d\n",minute,secs);
+        if(ds->sum != NULL)
+            fprintf(stdout,"Checksum: %s\n",ds->sum);
+        fprintf(stdout,"Total number of keys: %lu\n",ds->keycount);
+        if(args.match != NULL)
+            fprintf(stdout,"Left out by --match: %lu keys\n",ds->skipped);
+        fprintf(stdout,"Distribution:\n");
+        fprintf(stdout,"+++++++++++++++++++++++++++++++++++++++++++++++++++\n");
+        fprintf(stdout,"+ Key Type + Number of Keys + Percentage of Total +\n");
+        fprintf(stdout,"+  String  +  %12lu  + %11.2f%%        +\n",ds->keyper[0],(((float)ds->keyper[0]*100)/(float)ds->keycount));
+        fprintf(stdout,"+   List   +  %12lu  + %11.2f%%        +\n",ds->keyper[1],(((float)ds->keyper[1]*100)/(float)ds->keycount));
+        fprintf(stdout,"+   Set    +  %12lu  + %11.2f%%        +\n",ds->keyper[2],(((float)ds->keyper[2]*100)/(float)ds->keycount));
+        fprintf(stdout,"+Sorted Set+  %12lu  + %11.2f%%        +\n",ds->keyper[3],(((float)ds->keyper[3]*100)/(float)ds->keycount));
+        fprintf(stdout,"+   Hash   +  %12lu  + %11.2f%%        +\n",ds->keyper[4],(((float)ds->keyper[4]*100)/(float)ds->keycount));
+        fprintf(stdout,"+  Zipmap  +  %12lu  + %11.2f%%        +\n",ds->keyper[5],(((float)ds->keyper[5]*100)/(float)ds->keycount));
+        fprintf(stdout,"+ Ziplist  +  %12lu  + %11.2f%%        +\n",ds->keyper[6],(((float)ds->keyper[6]*100)/(float)ds->keycount));
+        fprintf(stdout,"+  Intset  +  %12lu  + %11.2f%%        +\n",ds->keyper[7],(((float)ds->keyper[7]*100)/(float)ds->keycount));
+        fprintf(stdout,"+   SSZL   +  %12lu  + %11.2f%%        +\n",ds->keyper[8],(((float)ds->keyper[8]*100)/(float)ds->keycount));
+        fprintf(stdout,"+   HMZL   +  %12lu  + %11.2f%%        +\n",ds->keyper[9],(((float)ds->keyper[9]*100)/(float)ds->keycount));
+        fprintf(stdout,"+Quicklist +  %12lu  + %11.2f%%        +\n",ds->keyper[10],(((float)ds->keyper[10]*100)/(float)ds->keycount));
+        fprintf(stdout,"+++++++++++++++++++++++++++++++++++++++++++++++++++\n");
+        fprintf(stdout,"Largest key: %s with size %" PRIu64 " bytes\n",big ? big : "(null)",bigsize);
+        print_dbs(ds,NULL);
+        print_tops(ds,NULL);
+        print_hists(ds,NULL);
+        print_expiry(ds,NULL);
+        fprintf(stdout,"Peak key memory: %zu bytes\n",ds->peak);
+        fprintf(stdout,"Dumpread complete.\n");
+    }
+}
+
+/*
+    Checksum verification
+    Redis ends an RDB file with the CRC64 of everything before it, or 0 when rdbchecksum
+    is off. With --verify a mapped file is checksummed by a thread of its own while the
+    parse runs, and a stream by the reader as each window is used up, so neither needs a
+    second pass over the file.
+    CV : Checksum Verification
+        fd  = reader of the file
+        tid = thread checksumming the mapping
+        on  = tid was started
+        crc = checksum of the mapping, up to the last 8 bytes
+*/
+struct CV {
+    struct RR *fd;
+    pthread_t tid;
+    int on;
+    uint64_t crc;
+};
+
+static void* cv_thread(void *arg){
+    struct CV *cv = arg;
+    cv->crc = crc64(0,cv->fd->map,cv->fd->size - 8);
+    return NULL;
+}
+
+/* Before anything is read from fd */
+static void cv_start(struct CV *cv, struct RR *fd){
+    memset(cv,0,sizeof(struct CV));
+    cv->fd = fd;
+    if(!rr_mapped(fd))
+        fd->sum = 1;
+    else if(fd->size >= 8 && pthread_create(&cv->tid,NULL,cv_thread,cv) == 0)
+        cv->on = 1;
+}
+
+/*
+    Once the parse is over. With done set the parse went without error and the outcome is
+    put in ds->sum, a dump that ends before 0xFF fails as well as one whose checksum doesn't
+    match. Returns 4 when it doesn't match, the file doesn't end right after it or the
+    dump is cut short, 0 otherwise.
+*/
+static int cv_finish(struct CV *cv, struct DS *ds, const char *path, int done){
+    struct RR *fd = cv->fd;
+    unsigned char tail[8];
+    uint64_t want = 0, got;
+    int i;
+    if(cv->on)
+        pthread_join(cv->tid,NULL);
+    if(!done)
+        return 0;
+    if(!ds->eof){
+        fprintf(stderr,"ERROR : %s ends before the 0xFF opcode\n",path);
+        ds->sum = "BAD, the dump ends before the 0xFF opcode";
+        return 4;
+    }
+    if(rr_mapped(fd)){
+        if(!cv->on)
+            cv->crc = fd->size >= 8 ? crc64(0,fd->map,fd->size - 8) : 0;
+        got = cv->crc;
+        if(rr_tell(fd) + 8 != fd->size){
+            fprintf(stderr,"ERROR : %s should end 8 bytes after the 0xFF opcode at %" PRIu64 ", it is %" PRIu64 " bytes\n",
+                    path,rr_tell(fd) - 1,fd->size);
+            ds->sum = "BAD, the file doesn't end after the checksum";
+            return 4;
+        }
+        memcpy(tail,fd->map + fd->size - 8,8);
+    } else {
+        got = rr_crc(fd);
+        if(rr_read(fd,tail,8) != 8){
+            fprintf(stderr,"ERROR : %s ends before its checksum\n",path);
+            ds->sum = "BAD, the file ends before the checksum";
+            return 4;
+        }
+        if(rr_read(fd,tail,1) == 1){
+            fprintf(stderr,"ERROR : %s goes on after its checksum\n",path);
+            ds->sum = "BAD, the file doesn't end after the checksum";
+            return 4;
+        }
+    }
+    /* Stored little endian */
+    for(i=7;i>=0;i--)
+        want = (want << 8) | tail[i];
+    if(want == 0){
+        ds->sum = "not in the file (rdbchecksum no)";
+        return 0;
+    }
+    if(want != got){
+        fprintf(stderr,"ERROR : %s checksum is %016" PRIx64 " but its contents give %016" PRIx64 "\n",path,want,got);
+        ds->sum = "BAD, it doesn't match the contents";
+        return 4;
+    }
+    ds->sum = "OK";
+    return 0;
+}
+
+/*
+    Batch mode
+    With --batch every RDB file is parsed on its own by a pool of threads, one file per
+    thread at a time. A file carries all of its state in its BF: reader, out file, stats
+    and return code, the only things shared are the options in args. Once every file is
+    done their stats are merged in the order they were given, so the totals don't depend
+    on which thread finished first.
+    BF : Batch File
+        path  = RDB file
+        out   = its out file in the out dir
+        dev   = index of the disk it is on in BQ
+        ds    = its stats
+        secs  = time taken to parse it
+        rc    = what dumpread would have returned for it alone
+        state = 0 waiting, 1 being parsed, 2 done
+*/
+struct BF {
+    const char *path;
+    char *out;
+    int dev;
+    struct DS ds;
+    int secs;
+    int rc;
+    int state;
+};
+
+/*
+    BD : Batch Disk, one for each device the files are on
+        dev  = st_dev of the files
+        cap  = files parsed from it at once, 1 for a spinning disk since a second reader
+               only adds seeks, every thread otherwise
+        busy = files being parsed from it
+*/
+struct BD {
+    dev_t dev;
+    int cap;
+    int busy;
+};
+
+/*
+    BQ : Batch Queue, the files and disks the pool threads take work from
+        f/nf    = the files
+        d/nd    = the disks
+        started = files handed out
+        done    = files finished
+*/
+struct BQ {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    struct BF *f;
+    int nf;
+    struct BD *d;
+    int nd;
+    int started;
+    int done;
+};
+
+/* Linux says if a block device spins in sysfs, a partition's disk has the queue */
+static int bd_rotational(dev_t dev){
+    char path[96];
+    FILE *f;
+    int c;
+    snprintf(path,sizeof(path),"/sys/dev/block/%u:%u/queue/rotational",major(dev),minor(dev));
+    if((f = fopen(path,"r")) == NULL){
+        snprintf(path,sizeof(path),"/sys/dev/block/%u:%u/../queue/rotational",major(dev),minor(dev));
+        f = fopen(path,"r");
+    }
+    /* Not a block device (tmpfs, NFS, ...), nothing to go on */
+    if(f == NULL)
+        return 0;
+    c = fgetc(f);
+    fclose(f);
+    return c == '1';
+}
+
+/* Parse file number src of the batch into its own out file */
+static void batch_file(struct BF *f, uint32_t src){
+    struct timespec begin, end;
+    struct RR *fd;
+    struct OW *fo;
+    struct CV cv;
+    int sum = 0;
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    if(init_DS(&f->ds) != 0){
+        fprintf(stderr,"ERROR : Could not allocate the top keys for %s\n",f->path);
+        f->rc = 2;
+        return;
+    }
+    f->ds.src = src;
+    fd = rr_open(f->path);
+    if(fd == NULL){
+        fprintf(stderr,"ERROR : Could not open file %s for binary read!\n",f->path);
+        f->rc = 2;
+        return;
+    }
+    fo = ow_open(f->out,args.direct);
+    if(fo == NULL){
+        fprintf(stderr,"ERROR : Could not open file %s for write!\n",f->out);
+        rr_close(fd);
+        f->rc = 2;
+        return;
+    }
+    if(args.verify)
+        cv_start(&cv,fd);
+    f->rc = check_magic(fd,0);
+    /* Like a single file, a version we don't know is still given a go */
+    if(f->rc == 0){
+        check_rdb_version(fd,0);
+        f->rc = parse_range(fd,&f->ds,fo,NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    f->secs = end.tv_sec - begin.tv_sec;
+    if(args.verify)
+        sum = cv_finish(&cv,&f->ds,f->path,f->rc == 0);
+    if(f->rc == 0 && f->ds.eof){
+        check_dbs(&f->ds,f->path);
+        print_summary(&f->ds,fo,f->secs,0);
+    }
+    /* A file that fails its checksum or is cut short stays out of the totals */
+    if(f->rc == 0)
+        f->rc = sum;
+    rr_close(fd);
+    if(ow_close(fo) != 0){
+        fprintf(stderr,"ERROR : Could not write all of %s\n",f->out);
+        if(f->rc == 0)
+            f->rc = 2;
+    }
+}
+
+/* Next file whose disk has room for another reader, NULL if there isn't one right now */
+static struct BF* bq_next(struct BQ *q){
+    int i;
+    for(i=0;i<q->nf;i++)
+        if(q->f[i].state == 0 && q->d[q->f[i].dev].busy < q->d[q->f[i].dev].cap)
+            return &q->f[i];
+    return NULL;
+}
+
+static void* batch_worker(void *arg){
+    struct BQ *q = arg;
+    struct BF *f;
+    char line[PATH_MAX + 64];
+    pthread_mutex_lock(&q->lock);
+    while(q->started < q->nf){
+        if((f = bq_next(q)) == NULL){
+            pthread_cond_wait(&q->idle,&q->lock);
+            continue;
+        }
+        f->state = 1;
+        q->started++;
+        q->d[f->dev].busy++;
+        pthread_mutex_unlock(&q->lock);
+        batch_file(f,f - q->f);
+        pthread_mutex_lock(&q->lock);
+        q->d[f->dev].busy--;
+        f->state = 2;
+        q->done++;
+        /* Padded over the progress line, which is drawn again on the next tick */
+        if(args.noisy && f->rc == 0 && f->ds.eof)
+            snprintf(line,sizeof(line),"[%d/%d] %s : %lu keys in %d:%.2d",q->done,q->nf,f->path,
+                    f->ds.keycount,f->secs/60,f->secs%60);
+        else
+            snprintf(line,sizeof(line),"[%d/%d] %s : failed, left out of the totals",q->done,q->nf,f->path);
+        if(args.noisy)
+            fprintf(stdout,"\r%-96s\n",line);
+        pthread_cond_broadcast(&q->idle);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+/*
+    Parse every --batch file into dir and merge their stats into ds. Files that fail are
+    left out of ds and the first of their return codes is returned. ds->eof is set when
+    at least one file made it into the totals.
+*/
+static int parse_batch(const char *dir, struct DS *ds){
+    struct BQ q;
+    struct stat st;
+    pthread_t *tid = NULL;
+    const char *base;
+    int i, k, n = 0, io = 0, rc = 0, eof = 0;
+    memset(&q,0,sizeof(struct BQ));
+    pthread_mutex_init(&q.lock,NULL);
+    pthread_cond_init(&q.idle,NULL);
+    q.nf = args.nfiles;
+    q.f = calloc(q.nf,sizeof(struct BF));
+    q.d = calloc(q.nf,sizeof(struct BD));
+    if(q.f == NULL || q.d == NULL){
+        fprintf(stderr,"ERROR : Could not allocate the batch\n");
+        rc = 2;
+        goto end;
+    }
+    for(i=0;i<q.nf;i++){
+        q.f[i].path = args.files[i];
+        base = strrchr(q.f[i].path,'/');
+        base = base != NULL ? base + 1 : q.f[i].path;
+        q.f[i].out = malloc(strlen(dir) + strlen(base) + 6);
+        if(q.f[i].out == NULL){
+            fprintf(stderr,"ERROR : Could not allocate the batch\n");
+            rc = 2;
+            goto end;
+        }
+        sprintf(q.f[i].out,"%s/%s.out",dir,base);
+        for(k=0;k<i;k++){
+            if(strcmp(q.f[k].out,q.f[i].out) == 0){
+                fprintf(stderr,"ERROR : %s and %s would both write %s\n",q.f[k].path,q.f[i].path,q.f[i].out);
+                rc = 1;
+                goto end;
+            }
+        }
+        /* Anything that can't be looked at fails when it is opened */
+        if(stat(q.f[i].path,&st) != 0)
+            st.st_dev = 0;
+        for(k=0;k<q.nd && q.d[k].dev != st.st_dev;k++);
+        if(k == q.nd){
+            q.d[k].dev = st.st_dev;
+            q.d[k].cap = bd_rotational(st.st_dev) ? 1 : args.threads;
+            io += q.d[k].cap;
+            q.nd++;
+        }
+        q.f[i].dev = k;
     }
+    /* No more threads than files, or than the disks can keep fed */
+    n = args.threads;
+    if(n > q.nf)
+        n = q.nf;
+    if(n > io)
+        n = io;
+    if(n < 1)
+        n = 1;
+    debug_print("DEBUG : %d batch threads for %d files on %d disks\n",n,q.nf,q.nd);
+    tid = calloc(n,sizeof(pthread_t));
+    for(i=0;tid != NULL && i<n;i++)
+        if(pthread_create(&tid[i],NULL,batch_worker,&q) != 0)
+            break;
+    n = tid != NULL ? i : 0;
+    /* Out of threads, do it ourselves */
+    if(n == 0)
+        batch_worker(&q);
+    for(i=0;i<n;i++)
+        pthread_join(tid[i],NULL);
+    for(i=0;i<q.nf;i++){
+        if(q.f[i].rc == 0 && q.f[i].ds.eof){
+            merge_DS(ds,&q.f[i].ds);
+            eof = 1;
+        } else {
+            fprintf(stderr,"WARNING : %s could not be parsed, it is left out of the totals\n",q.f[i].path);
+            if(rc == 0)
+                rc = q.f[i].rc != 0 ? q.f[i].rc : 2;
+        }
+    }
+    ds->eof = eof;
 end:
+    if(q.f != NULL){
+        for(i=0;i<q.nf;i++){
+            free(q.f[i].out);
+            free_DS(&q.f[i].ds);
+        }
+    }
+    free(q.f);
+    free(q.d);
+    free(tid);
+    pthread_mutex_destroy(&q.lock);
+    pthread_cond_destroy(&q.idle);
+    return rc;
+}
+
+/* 
+    Main
+    Where the magic starts.
+*/
+int main(int argc, char **argv){
+    struct timespec begin, end;
+    struct RR *fd = NULL;
+    struct OW *fo = NULL;
+    struct PL pl;
+    struct CV cv;
+    int rc = 0, done, sum = 0, i;
+    uint64_t total = 0;
+    struct stat st;
+    struct DS ds;
+    char report[PATH_MAX];
+    const char *out = argv[2];
+    args.noisy = 1;
+    args.full  = 0;
+    args.direct = 0;
+    args.pipeline = 0;
+    args.prefixes = 0;
+    args.pretty = 1;
+    args.threads = 0;
+    args.lzf_threads = 0;
+    args.top = 0;
+    args.hist = 0;
+    args.expiry = 0;
+    args.verify = 0;
+    args.profile = 0;
+    args.stream = 0;
+    args.value_buf = VS_BUFFER;
+    args.max_value = 0;
+    args.hist_csv = NULL;
+    args.progress_json = NULL;
+    args.progress_ms = 1000;
+    args.match = NULL;
+    aux.x = 0;
+    aux.name = 0;
+    memset(&ds,0,sizeof(struct DS));
+    rc = parse_args(argc, argv);
+    if(rc != 0) 
+        goto end;
+    if(init_DS(&ds) != 0){
+        fprintf(stderr,"ERROR : Could not allocate the top keys\n");
+        rc = 2;
+        goto end;
+    }
+    if(args.batch){
+        /* Every file gets its out file in the out dir, the totals go in merged.out */
+        if(mkdir(argv[2],0755) != 0 && errno != EEXIST){
+            fprintf(stderr,"ERROR : Could not create out dir %s\n",argv[2]);
+            rc = 2;
+            goto end;
+        }
+        snprintf(report,sizeof(report),"%s/merged.out",argv[2]);
+        out = report;
+    } else {
+        fd = rr_open(argv[1]);
+        if(fd == NULL){
+            fprintf(stderr,"ERROR : Could not open file %s for binary read!\n",argv[1]);
+            rc = 2;
+            goto end;
+        }
+    }
+    fo = ow_open(out,args.direct);
+    if(fo == NULL){
+        fprintf(stderr,"ERROR ; Could not open file %s for write!\n",out);
+        rc = 2;
+        goto end;
+    }
+    if(args.progress_json != NULL && (tm.json = fopen(args.progress_json,"w")) == NULL){
+        fprintf(stderr,"ERROR : Could not open file %s for write!\n",args.progress_json);
+        rc = 2;
+        goto end;
+    }
+    tm.bar = args.noisy && DEBUG == 0;
+    tm.ms = args.progress_ms;
+    /* Writes get a thread of their own, the parse goes on while a buffer is written */
+    if(args.pipeline && ow_async(fo,4) != 0)
+        fprintf(stderr,"WARNING : Could not start the writer thread, writing inline\n");
+    /* Only full mode decompresses anything worth handing off */
+    if(args.full && args.lzf_threads > 0 && lz_start(args.lzf_threads) != 0)
+        fprintf(stderr,"WARNING : Could not start the decompression threads, decompressing inline\n");
+    if(args.noisy && args.batch){
+        fprintf(stdout,"Redis RDB Dump Read\n");
+        fprintf(stdout,"RDB Files: %d\n",args.nfiles);
+        fprintf(stdout,"Out Dir  : %s\n",argv[2]);
+    } else if(args.noisy){
+        fprintf(stdout,"Redis RDB Dump Read\n");
+        fprintf(stdout,"RDB File : %s\n",argv[1]);
+        fprintf(stdout,"Out File : %s\n",argv[2]);
+    }
+    if(args.batch){
+        for(i=0;i<args.nfiles;i++)
+            if(stat(args.files[i],&st) == 0 && S_ISREG(st.st_mode))
+                total += st.st_size;
+        clock_gettime(CLOCK_MONOTONIC,&begin);
+        if(tm_start(total) != 0)
+            fprintf(stderr,"WARNING : Could not start the progress thread\n");
+        rc = parse_batch(argv[2],&ds);
+        tm_stop();
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        goto report;
+    }
+    if(args.verify)
+        cv_start(&cv,fd);
+    /* Look for Redis Magic Number */
+    rc = check_magic(fd,args.noisy);
+    if(rc != 0){
+        if(args.verify)
+            cv_finish(&cv,&ds,argv[1],0);
+        goto end;
+    }
+    /* Check RDB version. Currently we only support 0x30303037 */
+    rc = check_rdb_version(fd,args.noisy);
+    if(args.noisy)
+        fprintf(stdout,"Redis RDB file verification complete.\nGetting Redis RDB info now...\n");
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    if(args.threads > 1 && !rr_mapped(fd)){
+        fprintf(stderr,"WARNING : %s can't be mapped, parsing with a single thread\n",argv[1]);
+        args.threads = 1;
+    }
+    if(tm_start(fd->size) != 0)
+        fprintf(stderr,"WARNING : Could not start the progress thread\n");
+    /* The formatter would need the whole value copied over, a streamed one never is */
+    if(args.pipeline && args.stream && args.full && args.threads == 1)
+        fprintf(stderr,"WARNING : --pipeline only moves the writes to a thread when values are streamed\n");
+    if(args.threads > 1)
+        rc = parse_parallel(fd,&ds,fo,args.threads);
+    else if(args.pipeline && !(args.stream && args.full) && pl_start(&pl,fo) == 0){
+        rc = parse_range(fd,&ds,fo,&pl);
+        pl_stop(&pl);
+    }
+    else
+        rc = parse_range(fd,&ds,fo,NULL);
+    tm_stop();
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    if(args.verify)
+        sum = cv_finish(&cv,&ds,argv[1],rc == 0);
+    if(rc == 0 && ds.eof)
+        check_dbs(&ds,argv[1]);
+report:
+    /* A batch still reports the files that could be parsed */
+    done = ds.eof && (rc == 0 || args.batch);
+    if(done)
+        print_summary(&ds,fo,end.tv_sec - begin.tv_sec,args.noisy);
+    if(done && ds.kt != NULL)
+        kt_print(ds.kt,args.pretty);
+    if(done && args.hist_csv != NULL && write_hist_csv(&ds,args.hist_csv) != 0){
+        fprintf(stderr,"ERROR : Could not write histograms to %s\n",args.hist_csv);
+        rc = 2;
+    }
+    if(done && args.profile)
+        print_profile();
+    /* The summary is still written, the checksum line says what was wrong */
+    if(rc == 0)
+        rc = sum;
+end:
+    if(lz.tid != NULL)
+        lz_stop();
+    free_DS(&ds);
+    free_KM(args.match);
+    if(tm.json != NULL)
+        fclose(tm.json);
     if(fd != NULL)
-        fclose(fd);
-    if(fo != NULL)
-        fclose(fo);
+        rr_close(fd);
+    if(fo != NULL && ow_close(fo) != 0){
+        fprintf(stderr,"ERROR : Could not write all of %s\n",out);
+        if(rc == 0)
+            rc = 2;
+    }
     return rc;
 }
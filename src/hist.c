@@ -0,0 +1,56 @@
+/*
+    Log Histogram
+    Bucket bounds, percentiles and merging for hist.h.
+*/
+
+#include "hist.h"
+
+/* Smallest value that lands in bucket i */
+uint64_t lh_low(unsigned int i){
+    unsigned int e;
+    if(i < LH_SUB)
+        return i;
+    e = i / LH_SUB + LH_BITS - 1;
+    return (uint64_t)(LH_SUB + i % LH_SUB) << (e - LH_BITS);
+}
+
+/* Largest value that lands in bucket i */
+uint64_t lh_high(unsigned int i){
+    if(i < LH_SUB)
+        return i;
+    return lh_low(i) + (((uint64_t)1 << (i / LH_SUB - 1)) - 1);
+}
+
+/*
+    Value at or below which a fraction p of the values fall. Like HDR histograms this is
+    the top of the bucket the value is in, so it is never more than 1/LH_SUB too high,
+    and never more than the largest value added.
+*/
+uint64_t lh_pct(struct LH *h, double p){
+    uint64_t rank, seen = 0, v;
+    unsigned int i;
+    if(h->count == 0)
+        return 0;
+    /* Rounded up, the p50 of two values is the first */
+    rank = p * h->count;
+    if(rank < p * h->count)
+        rank++;
+    if(rank < 1)
+        rank = 1;
+    for(i=0;i<LH_BUCKETS;i++){
+        seen += h->b[i];
+        if(seen >= rank)
+            break;
+    }
+    v = i < LH_BUCKETS ? lh_high(i) : h->max;
+    return v < h->max ? v : h->max;
+}
+
+void lh_merge(struct LH *h, struct LH *from){
+    unsigned int i;
+    for(i=0;i<LH_BUCKETS;i++)
+        h->b[i] += from->b[i];
+    h->count += from->count;
+    if(from->max > h->max)
+        h->max = from->max;
+}
@@ -0,0 +1,50 @@
+/*
+    Log Histogram
+    Counts values in buckets that grow with the value, HDR histogram style. Every power
+    of two is split into LH_SUB linear buckets so any value lands in a bucket no more
+    than 1/LH_SUB wider than itself, and the whole uint64_t range fits in a fixed array.
+    Adding a value is a bit scan and an increment, nothing is allocated.
+*/
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+
+#define LH_BITS             4
+#define LH_SUB              (1 << LH_BITS)
+#define LH_BUCKETS          ((64 - LH_BITS + 1) * LH_SUB)
+
+/*
+    LH : Log Histogram
+        count = values added
+        max   = largest value added
+        b     = values per bucket, values under LH_SUB get a bucket each
+*/
+struct LH {
+    uint64_t count;
+    uint64_t max;
+    uint64_t b[LH_BUCKETS];
+};
+
+static inline unsigned int lh_bucket(uint64_t v){
+    unsigned int e;
+    if(v < LH_SUB)
+        return v;
+    e = 63 - __builtin_clzll(v);
+    return (e - LH_BITS + 1) * LH_SUB + ((v >> (e - LH_BITS)) & (LH_SUB - 1));
+}
+
+static inline void lh_add(struct LH *h, uint64_t v){
+    h->b[lh_bucket(v)]++;
+    h->count++;
+    if(v > h->max)
+        h->max = v;
+}
+
+uint64_t lh_low(unsigned int i);
+uint64_t lh_high(unsigned int i);
+uint64_t lh_pct(struct LH *h, double p);
+void lh_merge(struct LH *h, struct LH *from);
+
+#endif
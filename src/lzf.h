@@ -96,5 +96,28 @@ unsigned int
 lzf_decompress (const void *const in_data,  unsigned int in_len,
                 void             *out_data, unsigned int out_len);
 
+/*
+ * Same contract as lzf_decompress, from lzf_fast.c. Copies a word at a
+ * time with the widest registers the CPU has, picked on the first call.
+ * lzf_fast_impl names the one in use.
+ */
+unsigned int
+lzf_decompress_fast (const void *const in_data,  unsigned int in_len,
+                     void             *out_data, unsigned int out_len);
+
+const char *lzf_fast_impl (void);
+
+/*
+ * Decompress only the first out_len bytes, from lzf_fast.c. Stops as
+ * soon as out_data is full instead of failing with E2BIG, and in_data
+ * may be cut short anywhere after the bytes needed. Returns the number
+ * of bytes written, which is less than out_len only when the string is
+ * shorter or the data ran out. 2 * out_len + 3 bytes of input is always
+ * enough.
+ */
+unsigned int
+lzf_decompress_head (const void *const in_data,  unsigned int in_len,
+                     void             *out_data, unsigned int out_len);
+
 #endif
 
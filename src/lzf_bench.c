@@ -0,0 +1,179 @@
+/*
+    LZF Benchmark
+    HOW TO RUN:
+        lzf_bench [rdb file] [optional:seconds]
+    ARGUMENTS:
+        [rdb file]  - RDB file to pull compressed strings out of
+        [seconds]   - Optional. Time spent on each decoder, default 2
+    RETURN CODES:
+        0 - Success!
+        1 - Bad arguments
+        2 - Can't read the file or it has no compressed strings
+        3 - The decoders disagree
+    NOTES:
+        Compressed strings are found by looking for the 0xC3 string marker and checking that
+            the reference lzf_decompress() turns what follows into exactly the length it claims.
+            That skips a parse of the whole file and anything that passes is a real payload.
+        Every payload is checked against the reference before anything is timed.
+*/
+
+#include "lzf.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+    LP : LZF Payload
+        in   = compressed bytes in the mapping
+        clen = compressed length
+        ulen = decompressed length
+*/
+struct LP {
+    const unsigned char *in;
+    unsigned int clen;
+    unsigned int ulen;
+};
+
+typedef unsigned int (*lzf_fn)(const void *const, unsigned int, void *, unsigned int);
+
+/* RDB length encoding, returns bytes used or 0 for the special formats */
+static int rdb_len(const unsigned char *p, const unsigned char *end, uint64_t *len){
+    if(p >= end)
+        return 0;
+    switch(p[0] >> 6){
+        case 0:
+            *len = p[0] & 0x3F;
+            return 1;
+        case 1:
+            if(end - p < 2)
+                return 0;
+            *len = ((p[0] & 0x3F) << 8) | p[1];
+            return 2;
+        case 2:
+            if(end - p < 5)
+                return 0;
+            *len = ((uint64_t)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+            return 5;
+    }
+    return 0;
+}
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Decode every payload over and over for secs, returns MB/s of output */
+static double run(lzf_fn fn, struct LP *lp, unsigned long n, unsigned char *out, double secs, uint64_t *rounds){
+    unsigned long i;
+    uint64_t bytes = 0;
+    double begin = now(), t;
+    *rounds = 0;
+    do {
+        for(i=0;i<n;i++)
+            bytes += fn(lp[i].in,lp[i].clen,out,lp[i].ulen);
+        (*rounds)++;
+        t = now() - begin;
+    } while(t < secs);
+    return bytes / t / (1 << 20);
+}
+
+int main(int argc, char **argv){
+    struct stat st;
+    struct LP *lp = NULL;
+    unsigned long n = 0, cap = 0, i;
+    uint64_t clen, ulen, total = 0, rounds;
+    const unsigned char *map, *p, *end;
+    unsigned char *a = NULL, *b = NULL;
+    unsigned int maxlen = 0;
+    double secs = 2, ref, fast;
+    int fd, k, rc = 0;
+    if(argc < 2 || argc > 3){
+        fprintf(stderr,"Usage : lzf_bench [rdb file] [optional:seconds]\n");
+        return 1;
+    }
+    if(argc == 3 && (secs = atof(argv[2])) <= 0){
+        fprintf(stderr,"ERROR : Bad number of seconds %s\n",argv[2]);
+        return 1;
+    }
+    fd = open(argv[1],O_RDONLY);
+    if(fd < 0 || fstat(fd,&st) != 0 || st.st_size == 0){
+        fprintf(stderr,"ERROR : Could not open file %s for binary read!\n",argv[1]);
+        return 2;
+    }
+    map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(map == MAP_FAILED){
+        fprintf(stderr,"ERROR : Could not map %s\n",argv[1]);
+        return 2;
+    }
+    end = map + st.st_size;
+    a = malloc(1 << 20);
+    for(p = map; p < end && a != NULL; p++){
+        if(*p != 0xC3)
+            continue;
+        if((k = rdb_len(p+1,end,&clen)) == 0)
+            continue;
+        if((k += rdb_len(p+1+k,end,&ulen)) <= 1 || ulen == 0 || ulen > (1 << 20))
+            continue;
+        if(clen == 0 || clen > (uint64_t)(end - (p+1+k)))
+            continue;
+        if(lzf_decompress(p+1+k,clen,a,ulen) != ulen)
+            continue;
+        if(n == cap){
+            cap = cap ? cap * 2 : 1024;
+            lp = realloc(lp,sizeof(struct LP)*cap);
+            if(lp == NULL)
+                break;
+        }
+        lp[n].in = p+1+k;
+        lp[n].clen = clen;
+        lp[n].ulen = ulen;
+        if(ulen > maxlen)
+            maxlen = ulen;
+        total += ulen;
+        n++;
+        p += k + clen;
+    }
+    if(lp == NULL || n == 0){
+        fprintf(stderr,"ERROR : No compressed strings found in %s\n",argv[1]);
+        rc = 2;
+        goto end;
+    }
+    /* Room for the reference and the fast decoder side by side */
+    b = malloc(maxlen);
+    a = realloc(a,maxlen);
+    if(a == NULL || b == NULL){
+        fprintf(stderr,"ERROR : Could not allocate %u bytes\n",maxlen);
+        rc = 2;
+        goto end;
+    }
+    for(i=0;i<n;i++){
+        memset(b,0,lp[i].ulen);
+        if(lzf_decompress(lp[i].in,lp[i].clen,a,lp[i].ulen) != lp[i].ulen ||
+                lzf_decompress_fast(lp[i].in,lp[i].clen,b,lp[i].ulen) != lp[i].ulen ||
+                memcmp(a,b,lp[i].ulen) != 0){
+            fprintf(stderr,"ERROR : Decoders disagree on payload %lu at offset %ld\n",i,(long)(lp[i].in - map));
+            rc = 3;
+            goto end;
+        }
+    }
+    printf("Payloads   : %lu compressed strings, %llu bytes decompressed\n",n,(unsigned long long)total);
+    ref = run(lzf_decompress,lp,n,a,secs,&rounds);
+    printf("Reference  : %10.1f MB/s (%llu rounds)\n",ref,(unsigned long long)rounds);
+    fast = run(lzf_decompress_fast,lp,n,a,secs,&rounds);
+    printf("Fast %-6s: %10.1f MB/s (%llu rounds) %.2fx\n",lzf_fast_impl(),fast,(unsigned long long)rounds,fast/ref);
+end:
+    munmap((void*)map,st.st_size);
+    free(lp);
+    free(a);
+    free(b);
+    return rc;
+}
@@ -0,0 +1,240 @@
+/*
+    Fast LZF Decompression
+    Same format, arguments and return values as lzf_decompress() in lzf_d.c, which stays
+    the reference. Literal runs and back references are moved in whole 8/16/32 byte words
+    instead of one octet at a time, trusting that the overshoot lands in output that is
+    written again by the next instruction anyway. Near the end of either buffer there is
+    no room to overshoot so it drops back to exact copies.
+    The word width is picked once at runtime: AVX2 where the CPU has it, SSE2 on any
+    x86-64, plain 8 byte words everywhere else.
+*/
+
+#include "lzfP.h"
+#include "lzf.h"
+#include <errno.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# define LZF_X86 1
+#else
+# define LZF_X86 0
+#endif
+
+/* Constant n so the compiler turns these into single register loads and stores */
+static inline __attribute__((always_inline)) void wcopy(u8 *d, const u8 *s, unsigned int n){
+    memcpy(d,s,n);
+}
+
+/*
+    Copy len bytes from ref to op where ref is behind op and may overlap it. Words can only
+    be used when ref is at least a word behind, otherwise the word would read bytes it has
+    yet to write. A distance of one is a run of the same byte.
+*/
+static inline __attribute__((always_inline)) void backref(u8 *op, const u8 *ref, unsigned int len,
+        unsigned int room, unsigned int w){
+    unsigned int dist = op - ref, i;
+    if(dist >= w && room >= len + w){
+        for(i = 0; i < len; i += w)
+            wcopy(op+i,ref+i,w);
+    } else if(dist >= 8 && room >= len + 8){
+        for(i = 0; i < len; i += 8)
+            wcopy(op+i,ref+i,8);
+    } else if(dist == 1){
+        memset(op,*ref,len);
+    } else {
+        for(i = 0; i < len; i++)
+            op[i] = ref[i];
+    }
+}
+
+/*
+    The decoder proper. w is a constant in every caller so each one is compiled with its
+    own word size (and instruction set).
+*/
+static inline __attribute__((always_inline)) unsigned int lzf_run(const void *const in_data, unsigned int in_len,
+        void *out_data, unsigned int out_len, unsigned int w){
+    u8 const *ip = (const u8 *)in_data;
+    u8       *op = (u8 *)out_data;
+    u8 const *const in_end  = ip + in_len;
+    u8       *const out_end = op + out_len;
+    unsigned int ctrl, len;
+    u8 *ref;
+
+    if(in_len == 0)
+        return 0;
+    do {
+        ctrl = *ip++;
+        if(ctrl < (1 << 5)){
+            /* literal run, at most 32 bytes */
+            ctrl++;
+            if(op + ctrl > out_end){
+                errno = E2BIG;
+                return 0;
+            }
+            if(ip + ctrl > in_end){
+                errno = EINVAL;
+                return 0;
+            }
+            if(out_end - op >= 32 && in_end - ip >= 32){
+                if(w >= 32){
+                    wcopy(op,ip,32);
+                } else if(w == 16){
+                    wcopy(op,ip,16);
+                    wcopy(op+16,ip+16,16);
+                } else {
+                    wcopy(op,ip,8);
+                    wcopy(op+8,ip+8,8);
+                    wcopy(op+16,ip+16,8);
+                    wcopy(op+24,ip+24,8);
+                }
+            } else {
+                memcpy(op,ip,ctrl);
+            }
+            op += ctrl;
+            ip += ctrl;
+        } else {
+            /* back reference */
+            len = ctrl >> 5;
+            ref = op - ((ctrl & 0x1f) << 8) - 1;
+            if(ip >= in_end){
+                errno = EINVAL;
+                return 0;
+            }
+            if(len == 7){
+                len += *ip++;
+                if(ip >= in_end){
+                    errno = EINVAL;
+                    return 0;
+                }
+            }
+            ref -= *ip++;
+            len += 2;
+            if(op + len > out_end){
+                errno = E2BIG;
+                return 0;
+            }
+            if(ref < (u8 *)out_data){
+                errno = EINVAL;
+                return 0;
+            }
+            backref(op,ref,len,out_end - op,w);
+            op += len;
+        }
+    } while(ip < in_end);
+
+    return op - (u8 *)out_data;
+}
+
+static unsigned int lzf_decompress_w8(const void *const in_data, unsigned int in_len,
+        void *out_data, unsigned int out_len){
+    return lzf_run(in_data,in_len,out_data,out_len,8);
+}
+
+#if LZF_X86
+static unsigned int lzf_decompress_sse2(const void *const in_data, unsigned int in_len,
+        void *out_data, unsigned int out_len){
+    return lzf_run(in_data,in_len,out_data,out_len,16);
+}
+
+__attribute__((target("avx2")))
+static unsigned int lzf_decompress_avx2(const void *const in_data, unsigned int in_len,
+        void *out_data, unsigned int out_len){
+    return lzf_run(in_data,in_len,out_data,out_len,32);
+}
+#endif
+
+typedef unsigned int (*lzf_fn)(const void *const, unsigned int, void *, unsigned int);
+
+static unsigned int lzf_pick(const void *const in_data, unsigned int in_len,
+        void *out_data, unsigned int out_len);
+
+static lzf_fn lzf_impl = lzf_pick;
+
+/* First call decides which decoder every later call goes to */
+static unsigned int lzf_pick(const void *const in_data, unsigned int in_len,
+        void *out_data, unsigned int out_len){
+    lzf_fn fn = lzf_decompress_w8;
+#if LZF_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        fn = lzf_decompress_avx2;
+    else if(__builtin_cpu_supports("sse2"))
+        fn = lzf_decompress_sse2;
+#endif
+    __atomic_store_n(&lzf_impl,fn,__ATOMIC_RELAXED);
+    return fn(in_data,in_len,out_data,out_len);
+}
+
+unsigned int
+lzf_decompress_fast (const void *const in_data,  unsigned int in_len,
+                     void             *out_data, unsigned int out_len)
+{
+    return __atomic_load_n(&lzf_impl,__ATOMIC_RELAXED)(in_data,in_len,out_data,out_len);
+}
+
+/*
+    Only a few header bytes are ever asked for, so this goes an octet at a time and
+    simply stops when the output is full. A back reference can only point at bytes
+    already written, which are all inside out_data.
+*/
+unsigned int
+lzf_decompress_head (const void *const in_data,  unsigned int in_len,
+                     void             *out_data, unsigned int out_len)
+{
+    u8 const *ip = (const u8 *)in_data;
+    u8       *op = (u8 *)out_data;
+    u8 const *const in_end  = ip + in_len;
+    u8       *const out_end = op + out_len;
+    unsigned int ctrl, len;
+    u8 *ref;
+
+    while(ip < in_end && op < out_end){
+        ctrl = *ip++;
+        if(ctrl < (1 << 5)){
+            len = ctrl + 1;
+            if(len > (unsigned int)(in_end - ip))
+                len = in_end - ip;
+            if(len > (unsigned int)(out_end - op))
+                len = out_end - op;
+            memcpy(op,ip,len);
+            op += len;
+            ip += len;
+        } else {
+            len = ctrl >> 5;
+            ref = op - ((ctrl & 0x1f) << 8) - 1;
+            if(ip >= in_end)
+                break;
+            if(len == 7){
+                len += *ip++;
+                if(ip >= in_end)
+                    break;
+            }
+            ref -= *ip++;
+            len += 2;
+            if(ref < (u8 *)out_data){
+                errno = EINVAL;
+                return 0;
+            }
+            while(len-- && op < out_end)
+                *op++ = *ref++;
+        }
+    }
+
+    return op - (u8 *)out_data;
+}
+
+/* Name of the decoder lzf_decompress_fast() uses, for the benchmark */
+const char* lzf_fast_impl(void){
+    lzf_fn fn;
+    if(__atomic_load_n(&lzf_impl,__ATOMIC_RELAXED) == lzf_pick){
+        u8 in[2] = {0, 'x'}, out[1];
+        lzf_decompress_fast(in,2,out,1);
+    }
+    fn = __atomic_load_n(&lzf_impl,__ATOMIC_RELAXED);
+#if LZF_X86
+    if(fn == lzf_decompress_avx2)
+        return "avx2";
+    if(fn == lzf_decompress_sse2)
+        return "sse2";
+#endif
+    return "word8";
+}
@@ -0,0 +1,666 @@
+/*
+    Key Match
+    Pattern parsers, NFA and DFA construction for match.h.
+    Patterns are parsed straight into Thompson NFA fragments, every fragment has one node
+    in and one free epsilon out. Repeats in braces parse their operand again for every
+    copy, so there is no syntax tree to keep. The DFA is the usual subset construction,
+    a state being the set of byte set nodes (and the final node) its epsilon closure holds.
+*/
+
+#include "match.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KM_NODES            (1 << 16)
+#define KM_STATES           (1 << 13)
+#define KM_HASH             (KM_STATES * 2)
+#define KM_REPEAT           255
+#define KM_DEPTH            64
+
+/* KF : Key match Fragment, s is the way in and e an epsilon with no way out yet */
+struct KF {
+    int s;
+    int e;
+};
+
+/* KP : Key match Parser, what is left of the pattern being parsed */
+struct KP {
+    struct KM *km;
+    const char *p;
+    const char *end;
+    int depth;
+};
+
+static const struct KF kf_bad = {-1, -1};
+
+#define set_add(set,b)      ((set)[(b) >> 6] |= (uint64_t)1 << ((b) & 63))
+#define set_has(set,b)      (((set)[(b) >> 6] >> ((b) & 63)) & 1)
+
+static int km_fail(struct KM *km, const char *msg, const char *at){
+    if(km->err[0] == '\0'){
+        if(at != NULL)
+            snprintf(km->err,sizeof(km->err),"%s at '%.20s'",msg,at);
+        else
+            snprintf(km->err,sizeof(km->err),"%s",msg);
+    }
+    return -1;
+}
+
+static int kn_new(struct KM *km, const uint64_t *set){
+    struct KN *n;
+    if(km->nn == km->ncap){
+        if(km->ncap >= KM_NODES)
+            return km_fail(km,"Pattern is too long",NULL);
+        n = realloc(km->nfa,sizeof(struct KN)*(km->ncap ? km->ncap*2 : 64));
+        if(n == NULL)
+            return km_fail(km,"Out of memory",NULL);
+        km->nfa = n;
+        km->ncap = km->ncap ? km->ncap*2 : 64;
+    }
+    n = &km->nfa[km->nn];
+    memset(n,0,sizeof(struct KN));
+    if(set != NULL)
+        memcpy(n->set,set,sizeof(n->set));
+    n->eps = set == NULL;
+    n->out = -1;
+    n->out1 = -1;
+    return km->nn++;
+}
+
+/*
+    Fragment builders, a bad fragment in gives a bad fragment out so the parsers only
+    have to check once they're done
+*/
+
+static struct KF kf_eps(struct KM *km){
+    struct KF f;
+    f.s = f.e = kn_new(km,NULL);
+    return f;
+}
+
+static struct KF kf_set(struct KM *km, const uint64_t *set){
+    struct KF f;
+    f.s = kn_new(km,set);
+    f.e = kn_new(km,NULL);
+    if(f.s < 0 || f.e < 0)
+        return kf_bad;
+    km->nfa[f.s].out = f.e;
+    return f;
+}
+
+static struct KF kf_any(struct KM *km){
+    uint64_t set[4];
+    memset(set,0xFF,sizeof(set));
+    return kf_set(km,set);
+}
+
+static struct KF kf_byte(struct KM *km, unsigned char b){
+    uint64_t set[4] = {0};
+    set_add(set,b);
+    return kf_set(km,set);
+}
+
+static struct KF kf_cat(struct KM *km, struct KF a, struct KF b){
+    struct KF f;
+    if(a.s < 0 || b.s < 0)
+        return kf_bad;
+    km->nfa[a.e].out = b.s;
+    f.s = a.s;
+    f.e = b.e;
+    return f;
+}
+
+static struct KF kf_alt(struct KM *km, struct KF a, struct KF b){
+    struct KF f;
+    if(a.s < 0 || b.s < 0)
+        return kf_bad;
+    f.s = kn_new(km,NULL);
+    f.e = kn_new(km,NULL);
+    if(f.s < 0 || f.e < 0)
+        return kf_bad;
+    km->nfa[f.s].out = a.s;
+    km->nfa[f.s].out1 = b.s;
+    km->nfa[a.e].out = f.e;
+    km->nfa[b.e].out = f.e;
+    return f;
+}
+
+/* a* */
+static struct KF kf_star(struct KM *km, struct KF a){
+    struct KF f;
+    if(a.s < 0)
+        return kf_bad;
+    f.s = kn_new(km,NULL);
+    f.e = kn_new(km,NULL);
+    if(f.s < 0 || f.e < 0)
+        return kf_bad;
+    km->nfa[f.s].out = a.s;
+    km->nfa[f.s].out1 = f.e;
+    km->nfa[a.e].out = f.s;
+    return f;
+}
+
+/* a+ */
+static struct KF kf_plus(struct KM *km, struct KF a){
+    struct KF f;
+    if(a.s < 0)
+        return kf_bad;
+    f.s = a.s;
+    f.e = kn_new(km,NULL);
+    if(f.e < 0)
+        return kf_bad;
+    km->nfa[a.e].out = a.s;
+    km->nfa[a.e].out1 = f.e;
+    return f;
+}
+
+/* a? */
+static struct KF kf_opt(struct KM *km, struct KF a){
+    struct KF f;
+    if(a.s < 0)
+        return kf_bad;
+    f.s = kn_new(km,NULL);
+    if(f.s < 0)
+        return kf_bad;
+    km->nfa[f.s].out = a.s;
+    km->nfa[f.s].out1 = a.e;
+    f.e = a.e;
+    return f;
+}
+
+/*
+    Bracket expression, kp->p is just past the '['. A leading ^ negates it, ] right after
+    the [ or ^ is taken as a byte when regex is set, and \ takes the next byte as is.
+    Globs swap a backwards range like Redis does, a regex can't have one.
+*/
+static struct KF kp_class(struct KP *kp, int regex){
+    struct KM *km = kp->km;
+    const char *at = kp->p - 1;
+    uint64_t set[4] = {0};
+    int neg = 0, first = 1, i;
+    unsigned char lo, hi, t;
+    if(kp->p < kp->end && *kp->p == '^'){
+        neg = 1;
+        kp->p++;
+    }
+    while(1){
+        if(kp->p >= kp->end){
+            km_fail(km,"Missing ]",at);
+            return kf_bad;
+        }
+        if(*kp->p == ']' && !(regex && first))
+            break;
+        first = 0;
+        if(*kp->p == '\\' && kp->p + 1 < kp->end)
+            kp->p++;
+        lo = hi = *kp->p++;
+        if(kp->p + 1 < kp->end && *kp->p == '-' && kp->p[1] != ']'){
+            kp->p++;
+            if(*kp->p == '\\' && kp->p + 1 < kp->end)
+                kp->p++;
+            hi = *kp->p++;
+            if(lo > hi){
+                if(regex){
+                    km_fail(km,"Backwards range",at);
+                    return kf_bad;
+                }
+                t = lo;
+                lo = hi;
+                hi = t;
+            }
+        }
+        for(i=lo;i<=hi;i++)
+            set_add(set,i);
+    }
+    kp->p++;
+    if(neg)
+        for(i=0;i<4;i++)
+            set[i] = ~set[i];
+    return kf_set(km,set);
+}
+
+/* The byte set behind \d \w \s, and their negations in upper case */
+static int re_perl(unsigned char c, uint64_t *set){
+    int i, neg = c >= 'A' && c <= 'Z';
+    memset(set,0,4*sizeof(uint64_t));
+    switch(c | 0x20){
+        case 'd':
+            for(i='0';i<='9';i++)
+                set_add(set,i);
+            break;
+        case 'w':
+            for(i=0;i<256;i++)
+                if((i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || (i >= '0' && i <= '9') || i == '_')
+                    set_add(set,i);
+            break;
+        case 's':
+            set_add(set,' ');
+            for(i='\t';i<='\r';i++)
+                set_add(set,i);
+            break;
+        default:
+            return 0;
+    }
+    if(neg)
+        for(i=0;i<4;i++)
+            set[i] = ~set[i];
+    return 1;
+}
+
+static struct KF re_alt(struct KP *kp);
+
+static struct KF re_atom(struct KP *kp){
+    struct KM *km = kp->km;
+    const char *at = kp->p;
+    uint64_t set[4];
+    struct KF f;
+    unsigned char c = *kp->p++;
+    switch(c){
+        case '(':
+            if(++kp->depth > KM_DEPTH){
+                km_fail(km,"Too many nested groups",at);
+                return kf_bad;
+            }
+            f = re_alt(kp);
+            kp->depth--;
+            if(kp->p >= kp->end || *kp->p != ')'){
+                km_fail(km,"Missing )",at);
+                return kf_bad;
+            }
+            kp->p++;
+            return f;
+        case '*': case '+': case '?': case '{':
+            km_fail(km,"Nothing to repeat",at);
+            return kf_bad;
+        case '^': case '$':
+            km_fail(km,"^ and $ can only anchor the start and end of the pattern",at);
+            return kf_bad;
+        case '.':
+            return kf_any(km);
+        case '[':
+            return kp_class(kp,1);
+        case '\\':
+            if(kp->p >= kp->end){
+                km_fail(km,"Trailing \\",at);
+                return kf_bad;
+            }
+            c = *kp->p++;
+            if(re_perl(c,set))
+                return kf_set(km,set);
+            if(c == 'n')
+                c = '\n';
+            else if(c == 't')
+                c = '\t';
+            else if(c == 'r')
+                c = '\r';
+            return kf_byte(km,c);
+    }
+    return kf_byte(km,c);
+}
+
+/* {m}, {m,} or {m,n} with kp->p just past the '{', n is -1 when there's no upper bound */
+static int re_braces(struct KP *kp, int *m, int *n){
+    const char *p = kp->p;
+    char *end;
+    long a, b;
+    if(p >= kp->end || *p < '0' || *p > '9')
+        return -1;
+    a = b = strtol(p,&end,10);
+    p = end;
+    if(p < kp->end && *p == ','){
+        p++;
+        b = -1;
+        if(p < kp->end && *p >= '0' && *p <= '9'){
+            b = strtol(p,&end,10);
+            p = end;
+        }
+    }
+    if(p >= kp->end || *p != '}' || a > KM_REPEAT || b > KM_REPEAT || (b >= 0 && b < a) || (a == 0 && b == 0))
+        return -1;
+    kp->p = p + 1;
+    *m = a;
+    *n = b;
+    return 0;
+}
+
+/* An atom and its repeats, anything in braces parses [at,brace) again for every copy */
+static struct KF re_rep(struct KP *kp){
+    struct KM *km = kp->km;
+    const char *at = kp->p, *brace;
+    struct KF f = re_atom(kp), r, c;
+    struct KP sub;
+    int m, n, i;
+    while(f.s >= 0 && kp->p < kp->end){
+        switch(*kp->p){
+            case '*':
+                f = kf_star(km,f);
+                break;
+            case '+':
+                f = kf_plus(km,f);
+                break;
+            case '?':
+                f = kf_opt(km,f);
+                break;
+            case '{':
+                brace = kp->p++;
+                if(re_braces(kp,&m,&n) != 0){
+                    km_fail(km,"Bad {m,n}",brace);
+                    return kf_bad;
+                }
+                r = kf_eps(km);
+                for(i=0;i<(n < 0 ? m + 1 : n) && r.s >= 0;i++){
+                    c = f;
+                    if(i > 0){
+                        sub = *kp;
+                        sub.p = at;
+                        sub.end = brace;
+                        c = re_rep(&sub);
+                    }
+                    if(i >= m)
+                        c = n < 0 ? kf_star(km,c) : kf_opt(km,c);
+                    r = kf_cat(km,r,c);
+                }
+                f = r;
+                continue;
+            default:
+                return f;
+        }
+        kp->p++;
+    }
+    return f;
+}
+
+static struct KF re_cat(struct KP *kp){
+    struct KF f = kf_eps(kp->km);
+    while(f.s >= 0 && kp->p < kp->end && *kp->p != '|' && *kp->p != ')')
+        f = kf_cat(kp->km,f,re_rep(kp));
+    return f;
+}
+
+static struct KF re_alt(struct KP *kp){
+    struct KF f = re_cat(kp);
+    while(f.s >= 0 && kp->p < kp->end && *kp->p == '|'){
+        kp->p++;
+        f = kf_alt(kp->km,f,re_cat(kp));
+    }
+    return f;
+}
+
+/* Whole pattern as a regex, matched anywhere in the name unless anchored */
+static struct KF re_parse(struct KP *kp){
+    struct KM *km = kp->km;
+    struct KF f;
+    const char *q;
+    int head = 0, tail = 0, slashes = 0;
+    if(kp->p < kp->end && *kp->p == '^'){
+        head = 1;
+        kp->p++;
+    }
+    /* A $ at the end anchors unless it was escaped */
+    if(kp->end > kp->p && kp->end[-1] == '$'){
+        for(q=kp->end-1;q>kp->p && q[-1] == '\\';q--)
+            slashes++;
+        if(slashes % 2 == 0){
+            tail = 1;
+            kp->end--;
+        }
+    }
+    f = re_alt(kp);
+    if(f.s >= 0 && kp->p < kp->end){
+        km_fail(km,"Unmatched )",kp->p);
+        return kf_bad;
+    }
+    if(!head)
+        f = kf_cat(km,kf_star(km,kf_any(km)),f);
+    if(!tail)
+        f = kf_cat(km,f,kf_star(km,kf_any(km)));
+    return f;
+}
+
+/* Whole pattern as a glob, which always matches the whole name */
+static struct KF glob_parse(struct KP *kp){
+    struct KM *km = kp->km;
+    struct KF f = kf_eps(km);
+    unsigned char c;
+    while(f.s >= 0 && kp->p < kp->end){
+        c = *kp->p++;
+        switch(c){
+            case '*':
+                while(kp->p < kp->end && *kp->p == '*')
+                    kp->p++;
+                f = kf_cat(km,f,kf_star(km,kf_any(km)));
+                break;
+            case '?':
+                f = kf_cat(km,f,kf_any(km));
+                break;
+            case '[':
+                f = kf_cat(km,f,kp_class(kp,0));
+                break;
+            case '\\':
+                /* A trailing \ is just a \ */
+                if(kp->p < kp->end)
+                    c = *kp->p++;
+                f = kf_cat(km,f,kf_byte(km,c));
+                break;
+            default:
+                f = kf_cat(km,f,kf_byte(km,c));
+                break;
+        }
+    }
+    return f;
+}
+
+struct KM* create_KM(){
+    struct KM *km = calloc(1,sizeof(struct KM));
+    if(km == NULL)
+        return NULL;
+    /* Node 0 is where every pattern finishes */
+    km->fin = kn_new(km,NULL);
+    if(km->fin < 0){
+        free(km);
+        return NULL;
+    }
+    return km;
+}
+
+void free_KM(struct KM *km){
+    if(km == NULL)
+        return;
+    free(km->nfa);
+    free(km->starts);
+    free(km->next);
+    free(km->acc);
+    free(km);
+}
+
+/* Add a pattern, a glob when glob is set, else a regex. On error km->err says why */
+int km_add(struct KM *km, const char *pat, int glob){
+    struct KP kp;
+    struct KF f;
+    int *starts;
+    kp.km = km;
+    kp.p = pat;
+    kp.end = pat + strlen(pat);
+    kp.depth = 0;
+    km->err[0] = '\0';
+    f = glob ? glob_parse(&kp) : re_parse(&kp);
+    if(f.s < 0)
+        return km_fail(km,"Bad pattern",NULL);
+    km->nfa[f.e].out = km->fin;
+    starts = realloc(km->starts,sizeof(int)*(km->nstart+1));
+    if(starts == NULL)
+        return km_fail(km,"Out of memory",NULL);
+    km->starts = starts;
+    km->starts[km->nstart++] = f.s;
+    return 0;
+}
+
+/*
+    Split the bytes into classes no byte set node tells apart, so the DFA has a column
+    per class rather than per byte. Each set node splits every class in two at most.
+*/
+static void km_classes(struct KM *km){
+    int remap[256][2];
+    uint8_t cls[256];
+    unsigned int n, b;
+    int i, in;
+    memset(km->cls,0,sizeof(km->cls));
+    km->ncls = 1;
+    for(i=0;i<km->nn;i++){
+        if(km->nfa[i].eps)
+            continue;
+        memset(remap,-1,sizeof(remap));
+        n = 0;
+        for(b=0;b<256;b++){
+            in = set_has(km->nfa[i].set,b);
+            if(remap[km->cls[b]][in] < 0)
+                remap[km->cls[b]][in] = n++;
+            cls[b] = remap[km->cls[b]][in];
+        }
+        memcpy(km->cls,cls,sizeof(cls));
+        km->ncls = n;
+    }
+}
+
+/*
+    Epsilon closure of the nodes already in all, using stack. The DFA state is then only
+    the byte set nodes and the final node, epsilons don't change where a state can go.
+*/
+static void km_closure(struct KM *km, uint64_t *all, int *stack, int sp, uint64_t *state, int words){
+    struct KN *n;
+    int i, o[2], k;
+    while(sp > 0){
+        n = &km->nfa[stack[--sp]];
+        if(!n->eps)
+            continue;
+        o[0] = n->out;
+        o[1] = n->out1;
+        for(k=0;k<2;k++){
+            if(o[k] < 0 || set_has(all,o[k]))
+                continue;
+            set_add(all,o[k]);
+            stack[sp++] = o[k];
+        }
+    }
+    for(i=0;i<words;i++)
+        state[i] = 0;
+    for(i=0;i<km->nn;i++)
+        if(set_has(all,i) && (!km->nfa[i].eps || i == km->fin))
+            set_add(state,i);
+}
+
+static uint32_t km_hash(const uint64_t *state, int words){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int i;
+    for(i=0;i<words;i++)
+        h = (h ^ state[i]) * 0x100000001b3ULL;
+    return (h ^ (h >> 29)) & (KM_HASH - 1);
+}
+
+/*
+    Find or add a DFA state. Returns its number or -1 when there are too many states
+    or no memory for another one
+*/
+static int km_state(struct KM *km, uint64_t **sets, uint32_t *tab, uint32_t *cap, const uint64_t *state, int words){
+    uint32_t h = km_hash(state,words), s, ncap;
+    uint64_t *nsets;
+    uint32_t *next;
+    uint8_t *acc;
+    while((s = tab[h]) != 0){
+        if(memcmp(*sets + (s-1)*words,state,sizeof(uint64_t)*words) == 0)
+            return s - 1;
+        h = (h + 1) & (KM_HASH - 1);
+    }
+    if(km->nstates == KM_STATES)
+        return km_fail(km,"Patterns are too complex, they need too many DFA states",NULL);
+    if(km->nstates == *cap){
+        ncap = *cap ? *cap * 2 : 64;
+        nsets = realloc(*sets,sizeof(uint64_t)*words*ncap);
+        if(nsets == NULL)
+            return km_fail(km,"Out of memory",NULL);
+        *sets = nsets;
+        next = realloc(km->next,sizeof(uint32_t)*km->ncls*ncap);
+        if(next == NULL)
+            return km_fail(km,"Out of memory",NULL);
+        km->next = next;
+        acc = realloc(km->acc,ncap);
+        if(acc == NULL)
+            return km_fail(km,"Out of memory",NULL);
+        km->acc = acc;
+        *cap = ncap;
+    }
+    s = km->nstates++;
+    memcpy(*sets + s*words,state,sizeof(uint64_t)*words);
+    km->acc[s] = set_has(state,km->fin);
+    tab[h] = s + 1;
+    return s;
+}
+
+/* Build the DFA out of every pattern added so far */
+int km_compile(struct KM *km){
+    int words = (km->nn + 63) / 64, sp, i, rc = -1, t;
+    uint64_t *sets = NULL, *all, *state, *cur;
+    uint32_t *tab, cap = 0, s, k;
+    int *stack;
+    unsigned char rep[256];
+    unsigned int b;
+    km_classes(km);
+    for(b=256;b-->0;)
+        rep[km->cls[b]] = b;
+    all = calloc(words,sizeof(uint64_t));
+    state = calloc(words,sizeof(uint64_t));
+    stack = malloc(sizeof(int)*km->nn);
+    tab = calloc(KM_HASH,sizeof(uint32_t));
+    if(all == NULL || state == NULL || stack == NULL || tab == NULL){
+        km_fail(km,"Out of memory",NULL);
+        goto end;
+    }
+    km->nstates = 0;
+    /* KM_DEAD is the empty set, KM_START the closure of every pattern's start */
+    if(km_state(km,&sets,tab,&cap,state,words) != KM_DEAD)
+        goto end;
+    for(sp=0;sp<km->nstart;sp++){
+        set_add(all,km->starts[sp]);
+        stack[sp] = km->starts[sp];
+    }
+    km_closure(km,all,stack,sp,state,words);
+    if(km_state(km,&sets,tab,&cap,state,words) != KM_START)
+        goto end;
+    /* States are added at the end, so this runs until no new ones turn up */
+    for(s=0;s<km->nstates;s++){
+        for(k=0;k<km->ncls;k++){
+            memset(all,0,sizeof(uint64_t)*words);
+            sp = 0;
+            cur = sets + s*words;
+            for(i=0;i<km->nn;i++){
+                if(!set_has(cur,i) || km->nfa[i].eps || !set_has(km->nfa[i].set,rep[k]))
+                    continue;
+                if(!set_has(all,km->nfa[i].out)){
+                    set_add(all,km->nfa[i].out);
+                    stack[sp++] = km->nfa[i].out;
+                }
+            }
+            km_closure(km,all,stack,sp,state,words);
+            if((t = km_state(km,&sets,tab,&cap,state,words)) < 0)
+                goto end;
+            km->next[s*km->ncls + k] = t;
+        }
+    }
+    /* A match nothing can undo, the rest of the name doesn't need to be read */
+    for(s=0;s<km->nstates;s++){
+        if(!km->acc[s])
+            continue;
+        for(k=0;k<km->ncls && km->next[s*km->ncls + k] == s;k++);
+        if(k == km->ncls)
+            km->acc[s] = 2;
+    }
+    rc = 0;
+end:
+    free(sets);
+    free(all);
+    free(state);
+    free(stack);
+    free(tab);
+    return rc;
+}
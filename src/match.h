@@ -0,0 +1,84 @@
+/*
+    Key Match
+    Glob and regex filters on key names. Every pattern added is parsed into one shared
+    NFA, km_compile() turns that into a DFA over byte classes, and a name is then matched
+    with one table lookup per byte. A name stops being read as soon as it can't match
+    anything, or is sure to match whatever follows.
+    Globs are the Redis KEYS/SCAN MATCH kind: * ? [abc] [^a-z] and \ to escape, matched
+    against the whole name. Regexes are the extended POSIX subset: . [] [^] () | * + ?
+    {m} {m,} {m,n} \d \w \s (and \D \W \S), found anywhere in the name unless anchored
+    with ^ at the start or $ at the end. Both work on bytes, not characters.
+*/
+
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stdint.h>
+
+#define KM_DEAD             0
+#define KM_START            1
+
+/*
+    KN : Key match NFA node, a byte set with one way out or an epsilon with up to two
+        set  = bytes that move on to out
+        out  = next node, -1 for none
+        out1 = second way out of an epsilon, -1 for none
+        eps  = 1 for an epsilon, set is unused
+*/
+struct KN {
+    uint64_t set[4];
+    int out;
+    int out1;
+    uint8_t eps;
+};
+
+/*
+    KM : Key Match
+        nfa    = nodes of every pattern added
+        nn     = nodes used
+        ncap   = nodes allocated
+        starts = first node of each pattern
+        nstart = patterns added
+        fin    = node every pattern finishes on
+        cls    = byte class of every byte, bytes no pattern tells apart share a class
+        ncls   = byte classes
+        next   = DFA transitions, nstates rows of ncls
+        acc    = per DFA state, 0 no match yet, 1 match if the name ends here, 2 match
+        nstates= DFA states, KM_DEAD can never match and KM_START is where names begin
+        err    = why km_add() or km_compile() failed
+*/
+struct KM {
+    struct KN *nfa;
+    int nn;
+    int ncap;
+    int *starts;
+    int nstart;
+    int fin;
+    uint8_t cls[256];
+    unsigned int ncls;
+    uint32_t *next;
+    uint8_t *acc;
+    uint32_t nstates;
+    char err[128];
+};
+
+struct KM* create_KM();
+void free_KM(struct KM *km);
+int km_add(struct KM *km, const char *pat, int glob);
+int km_compile(struct KM *km);
+
+static inline int km_match(const struct KM *km, const char *name, unsigned long len){
+    const unsigned char *p = (const unsigned char*)name;
+    uint32_t s = KM_START;
+    unsigned long i;
+    for(i=0;i<len;i++){
+        if(km->acc[s] > 1)
+            return 1;
+        s = km->next[s*km->ncls + km->cls[p[i]]];
+        if(s == KM_DEAD)
+            return 0;
+    }
+    return km->acc[s] != 0;
+}
+
+#endif
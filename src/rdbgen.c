@@ -0,0 +1,619 @@
+/*
+    RDB Generator
+    Writes a synthetic RDB file for benchmarking dumpread and prefix, no Redis needed.
+    HOW TO RUN:
+        rdbgen [out file] [optional:--mix NAME] [optional:--keys N] [optional:--version 7|8]
+               [optional:--size MIN-MAX] [optional:--elements MIN-MAX] [optional:--ttl PCT]
+               [optional:--dbs N] [optional:--seed N] [optional:--no-lzf]
+    ARGUMENTS:
+        [out file]  - RDB file to write, - writes it to stdout
+        [--mix]     - Optional. Which encodings the keys get, mixed by default:
+                        strings = raw, integer and LZF compressed strings
+                        small   = ziplists, intsets and quicklists, what Redis 3.2 saves small
+                                  lists, sets, sorted sets and hashes as
+                        large   = plain lists, sets, sorted sets and hashes with many elements
+                        mixed   = all of the above
+                        big     = few keys, each a big compressed string, quicklist or hash
+        [--keys]    - Optional. Number of keys, 100000 by default.
+        [--version] - Optional. RDB version, 8 by default. Sorted sets are saved with binary
+                      scores (type 5) in 8 and with string scores (type 3) in 7.
+        [--size]    - Optional. Bytes in a string value or element, drawn log uniformly so
+                      small ones are the most common, as in most caches. Default depends on mix.
+        [--elements]- Optional. Elements in a list, set, sorted set or hash, drawn the same way.
+        [--ttl]     - Optional. Percentage of keys with an expiry, 30 by default.
+        [--dbs]     - Optional. Spread the keys over N databases, 1 by default.
+        [--seed]    - Optional. Seed of the generator, the same seed gives the same file.
+        [--no-lzf]  - Optional. Don't compress strings, like rdbcompression no.
+    RETURN CODES:
+        0 - Success!
+        1 - Bad arguments
+        2 - Can't write the out file
+    NOTES:
+        The file ends with a real CRC64 so it also passes dumpread --verify.
+        Zipmaps and module types aren't generated, dumpread doesn't read them.
+*/
+
+#include "crc64.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_KEYS            100000
+#define GEN_CTIME           1500000000
+#define LZF_HASH            (1 << 14)
+#define LZF_MAX_OFF         8192
+#define LZF_MAX_REF         264
+#define LZF_MAX_LIT         32
+#define ZL_NODE             128
+
+/* What a key is generated as, the RDB type is in gen_type[] */
+enum {
+    G_RAW, G_INT, G_LZF, G_LIST, G_SET, G_ZSET, G_HASH,
+    G_ZL, G_INTSET, G_ZSZL, G_HMZL, G_QL, G_KINDS
+};
+
+static const uint8_t gen_type[G_KINDS] = {0, 0, 0, 1, 2, 3, 4, 10, 11, 12, 13, 14};
+
+/*
+    GM : Generator Mix
+        name  = what --mix calls it
+        w     = weight of every kind, out of their sum
+        size  = default --size
+        elems = default --elements
+*/
+struct GM {
+    const char *name;
+    unsigned int w[G_KINDS];
+    unsigned long size[2];
+    unsigned long elems[2];
+};
+
+static const struct GM mixes[] = {
+    {"strings", {40, 30, 30, 0, 0, 0, 0, 0, 0, 0, 0, 0}, {1, 512}, {1, 1}},
+    {"small",   { 0,  0,  0, 0, 0, 0, 0, 15, 15, 20, 30, 20}, {1, 64}, {1, 128}},
+    {"large",   { 0,  0,  0, 20, 20, 20, 40, 0, 0, 0, 0, 0}, {1, 128}, {129, 2048}},
+    {"mixed",   {20, 10, 10, 5, 5, 5, 5, 8, 8, 8, 8, 8}, {1, 256}, {1, 512}},
+    {"big",     { 0,  0, 30, 0, 0, 0, 30, 0, 0, 0, 0, 40}, {16, 1024}, {1000, 20000}},
+};
+
+/*
+    GB : Generator Buffer, grows as bytes are put in it
+        p   = bytes
+        len = bytes used
+        cap = bytes allocated
+*/
+struct GB {
+    unsigned char *p;
+    size_t len;
+    size_t cap;
+};
+
+/* Arg vars */
+struct {
+    const struct GM *mix;
+    unsigned long keys;
+    unsigned long size[2];
+    unsigned long elems[2];
+    unsigned int ttl;
+    unsigned int dbs;
+    int version;
+    uint64_t seed;
+    uint8_t lzf : 1;
+} args;
+
+static uint64_t rng;
+static struct GB zl, node, cmp;
+
+/* xorshift64*, plenty for test data and the same everywhere for a seed */
+static uint64_t rnd(){
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned long rnd_range(unsigned long lo, unsigned long hi){
+    return lo + rnd() % (hi - lo + 1);
+}
+
+/* Log uniform in [lo,hi], a value is as likely to be 10-100 as 100-1000 */
+static unsigned long rnd_log(const unsigned long r[2]){
+    unsigned long lo = r[0] ? r[0] : 1, hi = r[1] > lo ? r[1] : lo, v;
+    unsigned int bits = 64 - __builtin_clzl(hi);
+    if(bits > 63)
+        bits = 63;
+    do
+        v = rnd() & (((unsigned long)1 << rnd_range(0,bits)) - 1);
+    while(v < lo || v > hi);
+    return v;
+}
+
+static void gb_room(struct GB *b, size_t n){
+    if(b->cap - b->len >= n)
+        return;
+    while(b->cap - b->len < n)
+        b->cap = b->cap ? b->cap * 2 : 4096;
+    b->p = realloc(b->p,b->cap);
+    if(b->p == NULL){
+        fprintf(stderr,"ERROR : Out of memory\n");
+        exit(2);
+    }
+}
+
+static void gb_put(struct GB *b, const void *p, size_t n){
+    gb_room(b,n);
+    memcpy(b->p + b->len,p,n);
+    b->len += n;
+}
+
+static void gb_byte(struct GB *b, uint8_t c){
+    gb_room(b,1);
+    b->p[b->len++] = c;
+}
+
+/* Little endian, n bytes of v */
+static void le_at(unsigned char *p, uint64_t v, int n){
+    int i;
+    for(i=0;i<n;i++)
+        p[i] = v >> (8*i);
+}
+
+static void gb_le(struct GB *b, uint64_t v, int n){
+    int i;
+    for(i=0;i<n;i++)
+        gb_byte(b,v >> (8*i));
+}
+
+static void put_length(struct GB *b, uint64_t n){
+    int i;
+    if(n < 64)
+        gb_byte(b,n);
+    else if(n < 16384){
+        gb_byte(b,0x40 | (n >> 8));
+        gb_byte(b,n & 0xFF);
+    } else if(n <= UINT32_MAX){
+        gb_byte(b,0x80);
+        for(i=3;i>=0;i--)
+            gb_byte(b,n >> (8*i));
+    } else {
+        gb_byte(b,0x81);
+        for(i=7;i>=0;i--)
+            gb_byte(b,n >> (8*i));
+    }
+}
+
+/*
+    Greedy LZF, the format lzf_decompress() reads: literal runs of up to 32 bytes and back
+    references of 3 to 264 bytes up to 8KB back, found through a hash of the next 3 bytes.
+    Returns the compressed length, 0 when it isn't smaller.
+*/
+static size_t lzf_pack(const unsigned char *in, size_t n, struct GB *out){
+    static uint32_t htab[LZF_HASH];
+    size_t i = 0, lit = 0, ref, off, l, start;
+    unsigned int h;
+    /* Left over entries of earlier strings are weeded out by the compare, no need to clear */
+    out->len = 0;
+    gb_room(out,n + n / 32 + 2);
+    start = 0;
+    while(i < n){
+        if(i + 2 < n){
+            h = ((in[i] << 16 | in[i+1] << 8 | in[i+2]) * 2654435761U) >> 18;
+            ref = htab[h];
+            htab[h] = i + 1;
+            if(ref > 0 && ref <= i && (off = i - ref) < LZF_MAX_OFF && memcmp(in+ref-1,in+i,3) == 0){
+                ref--;
+                for(l=3;i+l < n && l < LZF_MAX_REF && in[ref+l] == in[i+l];l++);
+                if(lit > 0){
+                    out->p[start] = lit - 1;
+                    lit = 0;
+                }
+                if(l - 2 < 7)
+                    out->p[out->len++] = ((l - 2) << 5) | (off >> 8);
+                else {
+                    out->p[out->len++] = (7 << 5) | (off >> 8);
+                    out->p[out->len++] = l - 2 - 7;
+                }
+                out->p[out->len++] = off & 0xFF;
+                i += l;
+                if(out->len >= n)
+                    return 0;
+                continue;
+            }
+        }
+        if(lit == 0)
+            start = out->len++;
+        out->p[out->len++] = in[i++];
+        if(++lit == LZF_MAX_LIT){
+            out->p[start] = lit - 1;
+            lit = 0;
+        }
+        if(out->len >= n)
+            return 0;
+    }
+    if(lit > 0)
+        out->p[start] = lit - 1;
+    return out->len < n ? out->len : 0;
+}
+
+/* A string as Redis saves it: LZF compressed when that is smaller, raw otherwise */
+static void put_string(struct GB *b, const unsigned char *s, size_t n){
+    if(args.lzf && n > 20 && lzf_pack(s,n,&cmp) > 0){
+        gb_byte(b,0xC3);
+        put_length(b,cmp.len);
+        put_length(b,n);
+        gb_put(b,cmp.p,cmp.len);
+        return;
+    }
+    put_length(b,n);
+    gb_put(b,s,n);
+}
+
+static void put_int(struct GB *b, int64_t v){
+    if(v >= INT8_MIN && v <= INT8_MAX){
+        gb_byte(b,0xC0);
+        gb_le(b,v,1);
+    } else if(v >= INT16_MIN && v <= INT16_MAX){
+        gb_byte(b,0xC1);
+        gb_le(b,v,2);
+    } else {
+        gb_byte(b,0xC2);
+        gb_le(b,v,4);
+    }
+}
+
+/*
+    Random text of n bytes. Words from a small alphabet, some repeated, so it compresses
+    about as well as the JSON and ids real caches hold.
+*/
+static const unsigned char* rnd_text(size_t n){
+    static struct GB t;
+    size_t w;
+    t.len = 0;
+    gb_room(&t,n + 16);
+    while(t.len < n){
+        if(t.len >= 16 && rnd() % 4 == 0){
+            w = rnd_range(4,16);
+            memmove(t.p + t.len,t.p + rnd() % (t.len - 15),w);
+            t.len += w;
+        } else
+            t.p[t.len++] = "abcdefghijklmnop:_-0123456789 {}\""[rnd() % 33];
+    }
+    return t.p;
+}
+
+static int64_t rnd_int(){
+    switch(rnd() % 4){
+        case 0: return rnd_range(0,12);
+        case 1: return (int64_t)rnd_range(0,255) - 128;
+        case 2: return (int64_t)rnd_range(0,65535) - 32768;
+        default: return (int32_t)rnd();
+    }
+}
+
+/* A ziplist entry, strings of up to 16383 bytes or any integer */
+static void zl_entry(struct GB *b, size_t *prev, int isint, size_t n){
+    size_t at = b->len;
+    int64_t v;
+    if(*prev < 254)
+        gb_byte(b,*prev);
+    else {
+        gb_byte(b,0xFE);
+        gb_le(b,*prev,4);
+    }
+    if(isint){
+        v = rnd() % 2 ? rnd_int() : (int64_t)rnd();
+        if(v >= 0 && v <= 12)
+            gb_byte(b,0xF1 + v);
+        else if(v >= INT8_MIN && v <= INT8_MAX){
+            gb_byte(b,0xFE);
+            gb_le(b,v,1);
+        } else if(v >= INT16_MIN && v <= INT16_MAX){
+            gb_byte(b,0xC0);
+            gb_le(b,v,2);
+        } else if(v >= -(1 << 23) && v < (1 << 23)){
+            gb_byte(b,0xF0);
+            gb_le(b,v,3);
+        } else if(v >= INT32_MIN && v <= INT32_MAX){
+            gb_byte(b,0xD0);
+            gb_le(b,v,4);
+        } else {
+            gb_byte(b,0xE0);
+            gb_le(b,v,8);
+        }
+    } else {
+        if(n > 16383)
+            n = 16383;
+        if(n < 64)
+            gb_byte(b,n);
+        else {
+            gb_byte(b,0x40 | (n >> 8));
+            gb_byte(b,n & 0xFF);
+        }
+        gb_put(b,rnd_text(n),n);
+    }
+    *prev = b->len - at;
+}
+
+/*
+    A ziplist of n entries into b. pairs makes every other entry a value for the one
+    before it, numbers are scores (zset) when set, otherwise either kind is picked.
+*/
+static void ziplist(struct GB *b, unsigned long n, int pairs, int scores){
+    size_t prev = 0, tail = 10;
+    unsigned long i;
+    int isint;
+    b->len = 0;
+    gb_room(b,10);
+    b->len = 10;
+    for(i=0;i<n;i++){
+        tail = b->len;
+        if(pairs && i % 2)
+            isint = scores || rnd() % 3 == 0;
+        else
+            isint = !pairs && rnd() % 3 == 0;
+        zl_entry(b,&prev,isint,rnd_log(args.size));
+    }
+    gb_byte(b,0xFF);
+    le_at(b->p,b->len,4);
+    le_at(b->p + 4,tail,4);
+    le_at(b->p + 8,n > 65535 ? 65535 : n,2);
+}
+
+static int cmp_i64(const void *a, const void *b){
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void intset(struct GB *b, unsigned long n){
+    static int64_t *v;
+    static unsigned long vn;
+    unsigned long i, j;
+    int w;
+    int64_t m = (int64_t[]){1000, 30000, 2000000000, 1LL << 40}[rnd() % 4];
+    if(vn < n){
+        vn = n;
+        v = realloc(v,sizeof(int64_t)*n);
+    }
+    for(i=0;i<n;i++)
+        v[i] = (int64_t)(rnd() % (2*m)) - m;
+    qsort(v,n,sizeof(int64_t),cmp_i64);
+    for(i=j=0;i<n;i++)
+        if(j == 0 || v[i] != v[j-1])
+            v[j++] = v[i];
+    w = m < 32768 ? 2 : m < 2147483647 ? 4 : 8;
+    b->len = 0;
+    gb_le(b,w,4);
+    gb_le(b,j,4);
+    for(i=0;i<j;i++)
+        gb_le(b,v[i],w);
+}
+
+/* Value of a key of kind k, the type byte comes first */
+static void put_value(struct GB *b, int k){
+    unsigned long n = rnd_log(args.elems), i, left;
+    size_t len;
+    char num[32];
+    double d;
+    gb_byte(b,k == G_ZSET && args.version >= 8 ? 5 : gen_type[k]);
+    /* Key name, under a handful of team prefixes for prefix to add up */
+    len = snprintf(num,sizeof(num),"%s:%lu:",
+        (const char*[]){"ds", "browse", "me", "cart", "sess", "search", "rec", "inv"}[rnd() % 8],(unsigned long)rnd_range(0,99999999));
+    gb_byte(b,len + 8);
+    gb_put(b,num,len);
+    gb_put(b,rnd_text(8),8);
+    switch(k){
+        case G_RAW:
+            len = rnd_log(args.size);
+            put_length(b,len);
+            gb_put(b,rnd_text(len),len);
+            break;
+        case G_INT:
+            put_int(b,rnd_int());
+            break;
+        case G_LZF:
+            len = rnd_log(args.size);
+            put_string(b,rnd_text(len),len);
+            break;
+        case G_LIST:
+        case G_SET:
+            put_length(b,n);
+            for(i=0;i<n;i++){
+                if(rnd() % 4 == 0)
+                    put_int(b,rnd_int());
+                else {
+                    len = rnd_log(args.size);
+                    put_string(b,rnd_text(len),len);
+                }
+            }
+            break;
+        case G_ZSET:
+            put_length(b,n);
+            for(i=0;i<n;i++){
+                len = rnd_log(args.size);
+                put_string(b,rnd_text(len),len);
+                d = (double)(rnd() % 1000000) / 100;
+                if(args.version >= 8)
+                    gb_put(b,&d,8);
+                else {
+                    len = snprintf(num,sizeof(num),"%.17g",d);
+                    gb_byte(b,len);
+                    gb_put(b,num,len);
+                }
+            }
+            break;
+        case G_HASH:
+            put_length(b,n);
+            for(i=0;i<2*n;i++){
+                len = rnd_log(args.size);
+                put_string(b,rnd_text(len),len);
+            }
+            break;
+        case G_ZL:
+        case G_ZSZL:
+        case G_HMZL:
+            ziplist(&zl,k == G_ZL ? n : 2*n,k != G_ZL,k == G_ZSZL);
+            put_string(b,zl.p,zl.len);
+            break;
+        case G_INTSET:
+            intset(&zl,n);
+            put_string(b,zl.p,zl.len);
+            break;
+        case G_QL:
+            /* Nodes of up to ZL_NODE entries, as list-max-ziplist-size -2 mostly ends up */
+            put_length(b,(n + ZL_NODE - 1) / ZL_NODE);
+            for(left=n;left>0;left-=i){
+                i = left < ZL_NODE ? left : ZL_NODE;
+                ziplist(&node,i,0,0);
+                put_string(b,node.p,node.len);
+            }
+            break;
+    }
+}
+
+static int parse_range_arg(const char *s, unsigned long r[2]){
+    char *end;
+    r[0] = strtoul(s,&end,10);
+    r[1] = *end == '-' ? strtoul(end+1,&end,10) : r[0];
+    return *end != '\0' || r[0] == 0 || r[1] < r[0];
+}
+
+static int parse_args(int argc, char **argv){
+    unsigned int i, k, have_size = 0, have_elems = 0;
+    args.mix = &mixes[3];
+    args.keys = GEN_KEYS;
+    args.ttl = 30;
+    args.dbs = 1;
+    args.version = 8;
+    args.seed = 1;
+    args.lzf = 1;
+    for(i=2;i<(unsigned int)argc;i++){
+        if(strcmp(argv[i],"--mix") == 0 && i+1 < (unsigned int)argc){
+            i++;
+            for(k=0;k<sizeof(mixes)/sizeof(mixes[0]);k++)
+                if(strcmp(argv[i],mixes[k].name) == 0)
+                    args.mix = &mixes[k];
+            if(strcmp(argv[i],args.mix->name) != 0){
+                fprintf(stderr,"ERROR : Unknown mix %s, pick strings, small, large, mixed or big\n",argv[i]);
+                return 1;
+            }
+        }else if(strcmp(argv[i],"--keys") == 0 && i+1 < (unsigned int)argc){
+            args.keys = strtoul(argv[++i],NULL,10);
+        }else if(strcmp(argv[i],"--version") == 0 && i+1 < (unsigned int)argc){
+            args.version = atoi(argv[++i]);
+            if(args.version != 7 && args.version != 8){
+                fprintf(stderr,"ERROR : Only RDB versions 7 and 8 are written\n");
+                return 1;
+            }
+        }else if(strcmp(argv[i],"--size") == 0 && i+1 < (unsigned int)argc){
+            if(parse_range_arg(argv[++i],args.size)){
+                fprintf(stderr,"ERROR : --size takes MIN-MAX, both over 0\n");
+                return 1;
+            }
+            have_size = 1;
+        }else if(strcmp(argv[i],"--elements") == 0 && i+1 < (unsigned int)argc){
+            if(parse_range_arg(argv[++i],args.elems)){
+                fprintf(stderr,"ERROR : --elements takes MIN-MAX, both over 0\n");
+                return 1;
+            }
+            have_elems = 1;
+        }else if(strcmp(argv[i],"--ttl") == 0 && i+1 < (unsigned int)argc){
+            args.ttl = atoi(argv[++i]);
+        }else if(strcmp(argv[i],"--dbs") == 0 && i+1 < (unsigned int)argc && atoi(argv[i+1]) > 0){
+            args.dbs = atoi(argv[++i]);
+        }else if(strcmp(argv[i],"--seed") == 0 && i+1 < (unsigned int)argc){
+            args.seed = strtoull(argv[++i],NULL,10);
+        }else if(strcmp(argv[i],"--no-lzf") == 0){
+            args.lzf = 0;
+        }else{
+            fprintf(stderr,"ERROR : Unknown argument %s\n",argv[i]);
+            return 1;
+        }
+    }
+    if(!have_size)
+        memcpy(args.size,args.mix->size,sizeof(args.size));
+    if(!have_elems)
+        memcpy(args.elems,args.mix->elems,sizeof(args.elems));
+    return 0;
+}
+
+static void put_aux(struct GB *b, const char *key, const char *value){
+    gb_byte(b,0xFA);
+    put_length(b,strlen(key));
+    gb_put(b,key,strlen(key));
+    put_length(b,strlen(value));
+    gb_put(b,value,strlen(value));
+}
+
+/* Write out what b holds, folding it into the checksum */
+static int gb_flush(struct GB *b, FILE *f, uint64_t *crc){
+    *crc = crc64(*crc,b->p,b->len);
+    if(fwrite(b->p,1,b->len,f) != b->len)
+        return -1;
+    b->len = 0;
+    return 0;
+}
+
+int main(int argc, char **argv){
+    struct GB b = {NULL, 0, 0};
+    FILE *f;
+    uint64_t crc = 0, exp;
+    unsigned long i, per, total = 0, db;
+    unsigned int k, pick;
+    char num[32];
+    if(argc < 2 || parse_args(argc,argv) != 0){
+        fprintf(stderr,"Usage : rdbgen [out file] [optional:--mix strings|small|large|mixed|big] [optional:--keys N] [optional:--version 7|8] [optional:--size MIN-MAX] [optional:--elements MIN-MAX] [optional:--ttl PCT] [optional:--dbs N] [optional:--seed N] [optional:--no-lzf]\n");
+        return 1;
+    }
+    rng = args.seed * 0x9E3779B97F4A7C15ULL + 1;
+    for(k=0;k<G_KINDS;k++)
+        total += args.mix->w[k];
+    f = strcmp(argv[1],"-") == 0 ? stdout : fopen(argv[1],"wb");
+    if(f == NULL){
+        fprintf(stderr,"ERROR : Could not open file %s for write!\n",argv[1]);
+        return 2;
+    }
+    snprintf(num,sizeof(num),"REDIS%04d",args.version);
+    gb_put(&b,num,9);
+    put_aux(&b,"redis-ver",args.version >= 8 ? "4.0.14" : "3.2.12");
+    put_aux(&b,"redis-bits","64");
+    snprintf(num,sizeof(num),"%d",GEN_CTIME);
+    put_aux(&b,"ctime",num);
+    for(db=0;db<args.dbs;db++){
+        per = args.keys / args.dbs + (db < args.keys % args.dbs);
+        gb_byte(&b,0xFE);
+        put_length(&b,db);
+        /* The expires size is what --ttl should give, not a count */
+        gb_byte(&b,0xFB);
+        put_length(&b,per);
+        put_length(&b,per * args.ttl / 100);
+        for(i=0;i<per;i++){
+            if(rnd() % 100 < args.ttl){
+                exp = GEN_CTIME + rnd_range(1,30*86400);
+                gb_byte(&b,0xFC);
+                gb_le(&b,exp * 1000,8);
+            }
+            pick = rnd() % total;
+            for(k=0;pick >= args.mix->w[k];k++)
+                pick -= args.mix->w[k];
+            put_value(&b,k);
+            if(b.len >= (1 << 20) && gb_flush(&b,f,&crc) != 0)
+                goto fail;
+        }
+    }
+    gb_byte(&b,0xFF);
+    if(gb_flush(&b,f,&crc) != 0)
+        goto fail;
+    gb_le(&b,crc,8);
+    if(fwrite(b.p,1,8,f) != 8 || fclose(f) != 0){
+        f = NULL;
+        goto fail;
+    }
+    free(b.p);
+    return 0;
+fail:
+    fprintf(stderr,"ERROR : Could not write all of %s\n",argv[1]);
+    if(f != NULL)
+        fclose(f);
+    return 2;
+}
@@ -0,0 +1,135 @@
+/*
+    RDB Reader
+    Opening, mapping and streaming for the reader in reader.h.
+    The inline calls in the header cover the case where the bytes are already in hand,
+    everything here is the slow path.
+*/
+
+#include "reader.h"
+#include "crc64.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    Open path, "-" is stdin.
+    Regular files are mapped whole and read only. The kernel is told we read it front to
+    back so it can read ahead aggressively. Anything that can't be mapped (empty, pipe,
+    no address space) is streamed through a window instead.
+*/
+struct RR* rr_open(const char *path){
+    struct stat st;
+    void *m;
+    int fd;
+    struct RR *r = malloc(sizeof(struct RR));
+    if(r == NULL)
+        return NULL;
+    memset(r,0,sizeof(struct RR));
+    if(strcmp(path,"-") == 0)
+        fd = STDIN_FILENO;
+    else
+        fd = open(path,O_RDONLY);
+    if(fd < 0){
+        free(r);
+        return NULL;
+    }
+    if(fstat(fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        r->size = st.st_size;
+        m = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        if(m != MAP_FAILED){
+            madvise(m,st.st_size,MADV_SEQUENTIAL);
+            close(fd);
+            r->map = m;
+            r->cur = r->map;
+            r->end = r->map + st.st_size;
+            r->fd  = -1;
+            return r;
+        }
+    }
+    r->buf = malloc(RR_WINDOW);
+    if(r->buf == NULL){
+        close(fd);
+        free(r);
+        return NULL;
+    }
+    r->cur = r->buf;
+    r->end = r->buf;
+    r->fd  = fd;
+    return r;
+}
+
+void rr_close(struct RR *r){
+    if(r == NULL)
+        return;
+    if(r->map != NULL)
+        munmap(r->map,r->end - r->map);
+    if(r->fd >= 0)
+        close(r->fd);
+    free(r->buf);
+    free(r);
+}
+
+/*
+    Refill the window once everything in it has been consumed.
+    Returns bytes now available, 0 on end of input or error.
+*/
+static size_t rr_fill(struct RR *r){
+    ssize_t got;
+    if(r->map != NULL)
+        return 0;
+    if(r->sum)
+        r->crc = crc64(r->crc,r->buf,r->cur - r->buf);
+    r->base += r->cur - r->buf;
+    r->cur = r->buf;
+    r->end = r->buf;
+    do {
+        got = read(r->fd,r->buf,RR_WINDOW);
+    } while(got < 0 && errno == EINTR);
+    if(got <= 0)
+        return 0;
+    r->end = r->buf + got;
+    return got;
+}
+
+size_t rr_read_slow(struct RR *r, void *dst, size_t n){
+    size_t have, done = 0;
+    unsigned char *d = dst;
+    while(done < n){
+        have = r->end - r->cur;
+        if(have == 0 && (have = rr_fill(r)) == 0){
+            r->err = 1;
+            break;
+        }
+        if(have > n - done)
+            have = n - done;
+        memcpy(d+done,r->cur,have);
+        r->cur += have;
+        done += have;
+    }
+    return done;
+}
+
+/* Skips on a stream just throw away what is in the window and read on */
+int rr_skip_slow(struct RR *r, uint64_t n){
+    uint64_t have;
+    while(n > 0){
+        have = r->end - r->cur;
+        if(have == 0 && (have = rr_fill(r)) == 0){
+            r->err = 1;
+            return -1;
+        }
+        if(have > n)
+            have = n;
+        r->cur += have;
+        n -= have;
+    }
+    return 0;
+}
+
+/* CRC64 of a stream up to the cursor, sum must have been set before the first read */
+uint64_t rr_crc(struct RR *r){
+    return crc64(r->crc,r->buf,r->cur - r->buf);
+}
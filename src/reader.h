@@ -0,0 +1,94 @@
+/*
+    RDB Reader
+    Cursor over a Redis RDB file. Regular files are mmap'd and the parser walks a pointer
+    over the mapping so strings, ziplists and intsets can be referenced in place instead of
+    being copied out. Anything that can't be mapped (pipes, stdin, sockets) is streamed
+    through a fixed window with read(2). Nothing ever seeks, skips are done by consuming
+    the window, so a BGSAVE can be piped straight in from redis-cli --rdb or ssh.
+    The rr_* calls mirror fread/fseek/ftell/ferror so the encoders read the same either way.
+*/
+
+#ifndef READER_H
+#define READER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RR_WINDOW           (1 << 20)
+
+/*
+    RR : RDB Reader
+        map  = start of the mapping, NULL when streaming
+        buf  = stream window, NULL when mapped
+        cur  = read cursor, into map or buf
+        end  = one past the last readable byte of map or buf
+        base = input offset of buf[0], bytes streamed before the window
+        size = size of the input in bytes, 0 if unknown (pipes)
+        fd   = file descriptor being streamed
+        crc  = CRC64 of the windows streamed before buf when sum is set
+        err  = set on a short read, sticky like ferror()
+        sum  = checksum a stream as it goes by, set before anything is read
+*/
+struct RR {
+    unsigned char *map;
+    unsigned char *buf;
+    unsigned char *cur;
+    unsigned char *end;
+    uint64_t base;
+    uint64_t size;
+    int fd;
+    uint64_t crc;
+    uint8_t err : 1;
+    uint8_t sum : 1;
+};
+
+struct RR* rr_open(const char *path);
+void rr_close(struct RR *r);
+size_t rr_read_slow(struct RR *r, void *dst, size_t n);
+int rr_skip_slow(struct RR *r, uint64_t n);
+uint64_t rr_crc(struct RR *r);
+
+static inline size_t rr_read(struct RR *r, void *dst, size_t n){
+    if((size_t)(r->end - r->cur) < n)
+        return rr_read_slow(r,dst,n);
+    memcpy(dst,r->cur,n);
+    r->cur += n;
+    return n;
+}
+
+/* Only valid on a mapped reader. Returns n bytes in place and advances past them. */
+static inline unsigned char* rr_ptr(struct RR *r, uint64_t n){
+    unsigned char *p = r->cur;
+    if(n > (uint64_t)(r->end - r->cur)){
+        r->err = 1;
+        r->cur = r->end;
+        return NULL;
+    }
+    r->cur += n;
+    return p;
+}
+
+static inline int rr_skip(struct RR *r, uint64_t n){
+    if((uint64_t)(r->end - r->cur) < n)
+        return rr_skip_slow(r,n);
+    r->cur += n;
+    return 0;
+}
+
+/* Bytes consumed so far, a plain counter for streams */
+static inline uint64_t rr_tell(struct RR *r){
+    if(r->map != NULL)
+        return r->cur - r->map;
+    return r->base + (r->cur - r->buf);
+}
+
+static inline int rr_mapped(struct RR *r){
+    return r->map != NULL;
+}
+
+static inline int rr_error(struct RR *r){
+    return r->err;
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+    Top Keys
+    Heap and name pool for top.h.
+*/
+
+#include "top.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TK_POOL             (64 << 10)
+
+void tk_init(struct TK *tk, unsigned int n){
+    memset(tk,0,sizeof(struct TK));
+    tk->n = n;
+}
+
+void tk_free(struct TK *tk){
+    free(tk->heap);
+    free(tk->pool);
+    memset(tk,0,sizeof(struct TK));
+}
+
+/* a ranks below b, smaller or the same size and further into the files */
+static inline int tk_below(struct TE *a, struct TE *b){
+    if(a->size != b->size)
+        return a->size < b->size;
+    return a->src > b->src || (a->src == b->src && a->off > b->off);
+}
+
+static void tk_down(struct TE *h, unsigned int used, unsigned int i){
+    struct TE t = h[i];
+    unsigned int c;
+    while((c = 2*i + 1) < used){
+        if(c + 1 < used && tk_below(&h[c+1],&h[c]))
+            c++;
+        if(!tk_below(&h[c],&t))
+            break;
+        h[i] = h[c];
+        i = c;
+    }
+    h[i] = t;
+}
+
+static void tk_up(struct TE *h, unsigned int i){
+    struct TE t = h[i];
+    unsigned int p;
+    while(i > 0 && tk_below(&t,&h[p = (i-1)/2])){
+        h[i] = h[p];
+        i = p;
+    }
+    h[i] = t;
+}
+
+/*
+    Room for len + 1 more bytes of names. Evicted names are dead weight, once they are
+    most of the pool the live ones are copied into a fresh one instead of growing it.
+*/
+static int tk_room(struct TK *tk, unsigned long len){
+    uint64_t cap = tk->cap ? tk->cap : TK_POOL;
+    unsigned int i;
+    char *pool;
+    if(tk->held + len + 1 <= tk->cap)
+        return 0;
+    if(tk->live * 2 > tk->held)
+        cap *= 2;
+    while(cap < tk->live + len + 1)
+        cap *= 2;
+    pool = malloc(cap);
+    if(pool == NULL)
+        return -1;
+    tk->held = 0;
+    for(i=0;i<tk->used;i++){
+        memcpy(pool+tk->held,tk->pool+tk->heap[i].name,tk->heap[i].len+1);
+        tk->heap[i].name = tk->held;
+        tk->held += tk->heap[i].len + 1;
+    }
+    free(tk->pool);
+    tk->pool = pool;
+    tk->cap = cap;
+    return 0;
+}
+
+void tk_add(struct TK *tk, uint64_t size, uint64_t off, const char *name, unsigned long len, uint8_t type, uint32_t db, uint32_t src){
+    struct TE e = {size, off, 0, len, db, src, type};
+    if(tk->n == 0 || (tk->used == tk->n && !tk_below(&tk->heap[0],&e)))
+        return;
+    if(tk->heap == NULL && (tk->heap = calloc(tk->n,sizeof(struct TE))) == NULL)
+        return;
+    if(tk_room(tk,len) != 0)
+        return;
+    e.name = tk->held;
+    memcpy(tk->pool+tk->held,name,len);
+    tk->pool[tk->held+len] = '\0';
+    tk->held += len + 1;
+    tk->live += len + 1;
+    if(tk->used < tk->n){
+        tk->heap[tk->used] = e;
+        tk_up(tk->heap,tk->used++);
+    } else {
+        tk->live -= tk->heap[0].len + 1;
+        tk->heap[0] = e;
+        tk_down(tk->heap,tk->used,0);
+    }
+}
+
+void tk_merge(struct TK *tk, struct TK *from){
+    unsigned int i;
+    struct TE *e;
+    for(i=0;i<from->used;i++){
+        e = &from->heap[i];
+        tk_add(tk,e->size,e->off,from->pool+e->name,e->len,e->type,e->db,e->src);
+    }
+}
+
+/* Biggest first. The heap is used up, nothing can be added after this */
+void tk_sort(struct TK *tk){
+    struct TE t;
+    unsigned int i;
+    if(tk->n == 0)
+        return;
+    for(i=tk->used;i>1;i--){
+        t = tk->heap[0];
+        tk->heap[0] = tk->heap[i-1];
+        tk->heap[i-1] = t;
+        tk_down(tk->heap,i-1,0);
+    }
+    tk->n = 0;
+}
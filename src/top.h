@@ -0,0 +1,65 @@
+/*
+    Top Keys
+    The n biggest keys seen so far, kept in a fixed size min-heap. A key smaller than the
+    smallest one kept is turned away with a single compare, one that gets in replaces the
+    root and is sifted down, so nothing per key is worse than O(log n). Names are copied
+    into a pool owned by the heap rather than malloc'd one at a time, and the heap itself
+    isn't allocated until the first key is added, so an unused TK costs nothing.
+*/
+
+#ifndef TOP_H
+#define TOP_H
+
+#include <stdint.h>
+
+/*
+    TE : Top Entry
+        size = estimated size of the key
+        off  = offset of the key in the RDB file, the earlier of two equal keys wins
+        src  = input file the key is in with --batch, the earlier file wins a tie first
+        name = offset of the name in the pool, NUL terminated
+        len  = bytes in the name
+        db   = database the key is in
+        type = RDB type byte
+*/
+struct TE {
+    uint64_t size;
+    uint64_t off;
+    uint64_t name;
+    uint32_t len;
+    uint32_t db;
+    uint32_t src;
+    uint8_t type;
+};
+
+/*
+    TK : Top Keys
+        heap = entries, heap[0] is the smallest kept until tk_sort()
+        used = entries in heap
+        n    = most entries kept
+        pool = names of the entries, and of evicted ones until it is compacted
+        held = bytes used in pool
+        cap  = bytes allocated for pool
+        live = bytes of pool that kept entries still point to
+*/
+struct TK {
+    struct TE *heap;
+    unsigned int used;
+    unsigned int n;
+    char *pool;
+    uint64_t held;
+    uint64_t cap;
+    uint64_t live;
+};
+
+void tk_init(struct TK *tk, unsigned int n);
+void tk_free(struct TK *tk);
+void tk_add(struct TK *tk, uint64_t size, uint64_t off, const char *name, unsigned long len, uint8_t type, uint32_t db, uint32_t src);
+void tk_merge(struct TK *tk, struct TK *from);
+void tk_sort(struct TK *tk);
+
+static inline const char* tk_name(struct TK *tk, unsigned int i){
+    return tk->pool + tk->heap[i].name;
+}
+
+#endif
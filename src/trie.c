@@ -0,0 +1,244 @@
+/*
+    Key Prefix Trie
+    Building, merging and printing for the trie in trie.h.
+*/
+
+#include "trie.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Initialize an empty node in the trie
+*/
+struct KT* create_KT(){
+    return calloc(1,sizeof(struct KT));
+}
+
+void free_KT(struct KT *tr){
+    uint8_t i;
+    if(tr == NULL)
+        return;
+    for(i=0;i<KEY_CHAR;i++)
+        free_KT(tr->next[i]);
+    free(tr->tl);
+    free(tr);
+}
+
+/*
+    Type code from the 9th character of a 'Type : ...' line, the second letter of the type
+    is enough to tell them apart (ziplists and zipmaps count as lists)
+*/
+uint8_t kt_type(int c){
+    switch(toupper(c)){
+        case 'A': return 1;
+        case 'E': return 2;
+        case 'I': return 3;
+        case 'N': return 4;
+        case 'O': return 5;
+        case 'T': return 6;
+        case 'U': return 7;
+        default:  return 0;
+    }
+}
+
+/*
+    Node of a key's prefix. The name is walked until a symbol, the end of the name or
+    KT_DEPTH characters, whichever comes first, and that node takes the key.
+    NULL if a node couldn't be allocated, the key is dropped like prefix always did.
+*/
+static struct KT* kt_find(struct KT *tr, const char *name, unsigned long len){
+    struct KT *tmp = tr;
+    unsigned long i;
+    int upper;
+    for(i=0;;i++){
+        upper = i < len ? toupper(name[i]) : '\n';
+        if((upper > 'Z') || (upper < '0') || ((upper > '9') && (upper < 'A')) || (i == KT_DEPTH))
+            break;
+        /* Get trie offset for character */
+        if((upper >= '0') && (upper <= '9')) upper -= START_NUMBER;
+        else upper -= START_LETTER;
+        if(tmp->next[upper] == NULL){
+            tmp->next[upper] = create_KT();
+            if(tmp->next[upper] == NULL){
+                printf("Couldn't make a new KT for key name, continue to next key\n");
+                return NULL;
+            }
+        }
+        tmp = tmp->next[upper];
+    }
+    return tmp;
+}
+
+/*
+    Count a key against its prefix. A node that sees keys of different types becomes
+    Multi (8). Returns -1 if the key was dropped.
+*/
+int kt_add(struct KT *tr, const char *name, unsigned long len, uint8_t type, uint64_t size, uint64_t exp){
+    struct KT *tmp = kt_find(tr,name,len);
+    if(tmp == NULL)
+        return -1;
+    tmp->num++;
+    if(tmp->type != 8){
+        if(tmp->type != 0 && tmp->type != type) tmp->type = 8;
+        else tmp->type = type;
+    }
+    tmp->size += size;
+    if(exp > tmp->bigttl)
+        tmp->bigttl = exp;
+    tmp->avgttl += exp;
+    return 0;
+}
+
+const char *kt_span_name[KT_SPANS] = {
+    "expired", "< 1 minute", "< 1 hour", "< 1 day", "< 1 week", "< 30 days", "< 1 year",
+    "later", "no TTL"
+};
+
+/* Span of the timeline a TTL in seconds falls in, TTLs that wrapped below 0 have expired */
+uint8_t kt_span(uint64_t ttl, int has_ttl){
+    static const uint64_t upto[KT_NOTTL - 1] = {0, 60, 3600, 86400, 604800, 2592000, 31536000};
+    uint8_t i;
+    if(!has_ttl)
+        return KT_NOTTL;
+    if((int64_t)ttl < 0)
+        return 0;
+    for(i=0;i<KT_NOTTL-1;i++)
+        if(ttl <= upto[i])
+            return i;
+    return KT_NOTTL - 1;
+}
+
+/* Count a key in its prefix's expiry timeline */
+int kt_expire(struct KT *tr, const char *name, unsigned long len, uint64_t size, uint8_t span){
+    struct KT *tmp = kt_find(tr,name,len);
+    if(tmp == NULL)
+        return -1;
+    if(tmp->tl == NULL && (tmp->tl = calloc(2*KT_SPANS,sizeof(uint64_t))) == NULL)
+        return -1;
+    tmp->tl[span]++;
+    tmp->tl[KT_SPANS+span] += size;
+    return 0;
+}
+
+/* Fold from into tr, used to combine the tries of parallel workers */
+void kt_merge(struct KT *tr, struct KT *from){
+    uint8_t i;
+    if(from->num > 0){
+        if(tr->num == 0) tr->type = from->type;
+        else if(tr->type != from->type) tr->type = 8;
+        tr->num += from->num;
+        tr->size += from->size;
+        tr->avgttl += from->avgttl;
+        if(from->bigttl > tr->bigttl)
+            tr->bigttl = from->bigttl;
+    }
+    if(from->tl != NULL && tr->tl == NULL){
+        tr->tl = from->tl;
+        from->tl = NULL;
+    } else if(from->tl != NULL){
+        for(i=0;i<2*KT_SPANS;i++)
+            tr->tl[i] += from->tl[i];
+    }
+    for(i=0;i<KEY_CHAR;i++){
+        if(from->next[i] == NULL) continue;
+        if(tr->next[i] == NULL){
+            /* Nothing here yet, take the whole branch */
+            tr->next[i] = from->next[i];
+            from->next[i] = NULL;
+        } else {
+            kt_merge(tr->next[i],from->next[i]);
+        }
+    }
+}
+
+/* Character for the i'th child of a node */
+static char kt_char(uint8_t i){
+    if(i>25 && i<=35)
+        return START_NUMBER+i;
+    if(i>35 && i<=51)
+        return START_SYM1+i;
+    if(i>51 && i<=59)
+        return START_SYM2+i;
+    if(i>59)
+        return START_SYM3+i;
+    return START_LETTER+i;
+}
+
+/*
+    Recursive method to display nice looking table of key prefix information
+    That free(nn) is crucial for many reasons
+*/
+static void print_full_analysis(struct KT *tr, char* name, int sz, int pretty){
+    char *nn;
+    uint8_t i;
+    if(name == NULL){
+        name = malloc(sizeof(char));
+        name[0] = '\0';
+        sz = 1;
+    }
+    if(tr->num > 0){
+        /* calculate percentage of keys from dump */
+        if(pretty){
+            if(tr->type == 1)      printf("| %-30.30s |    Hash    | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 2) printf("| %-30.30s |    Set     | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 3) printf("| %-30.30s |    List    | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 4) printf("| %-30.30s |   Intset   | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 5) printf("| %-30.30s | Sorted Set | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 6) printf("| %-30.30s |   String   | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 7) printf("| %-30.30s | Quicklist  | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 8) printf("| %-30.30s |   Multi    | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else                   printf("| %-30.30s |    N/A     | %-16"PRIu32" | %-18"PRIu64" | %-21"PRIu64" | %-21"PRIu64" |\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+        } else {
+            if(tr->type == 1)      printf("%s,Hash,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 2) printf("%s,Set,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 3) printf("%s,List,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 4) printf("%s,Intset,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 5) printf("%s,Sorted Set,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 6) printf("%s,String,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 7) printf("%s,Quicklist,%" PRIu32 ",%" PRIu64",%" PRIu64 ",%" PRIu64"\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else if(tr->type == 8) printf("%s,Multi,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+            else                   printf("%s,N/A,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",name,tr->num,tr->size,(tr->avgttl/tr->num),tr->bigttl);
+        }
+    }
+    for(i=0;i<KEY_CHAR;i++){
+        if(tr->next[i] == NULL) continue;
+        nn = malloc(sz+1);
+        snprintf(nn,sz+1,"%s%c",name,kt_char(i));
+        print_full_analysis(tr->next[i],nn,sz+1,pretty);
+        free(nn);
+    }
+}
+
+/* Print all key prefixes and their information */
+void kt_print(struct KT *tr, int pretty){
+    if(pretty){
+        printf("|--------------------------------|------------|------------------|--------------------|-----------------------|-----------------------|\n");
+        printf("|           Key Prefix           |    Type    |  Number of Keys  |    Size (Bytes)    | Average TTL (Seconds) | Largest TTL (Seconds) |\n");
+        printf("|--------------------------------|------------|------------------|--------------------|-----------------------|-----------------------|\n");
+        print_full_analysis(tr,0,0,pretty);
+        printf("|--------------------------------|------------|------------------|--------------------|-----------------------|-----------------------|\n");
+    } else {
+        print_full_analysis(tr,0,0,pretty);
+    }
+}
+
+static void kt_walk_at(struct KT *tr, char *name, int depth,
+        void (*fn)(const char *prefix, struct KT *node, void *arg), void *arg){
+    uint8_t i;
+    name[depth] = '\0';
+    fn(name,tr,arg);
+    for(i=0;i<KEY_CHAR;i++){
+        if(tr->next[i] == NULL) continue;
+        name[depth] = kt_char(i);
+        kt_walk_at(tr->next[i],name,depth+1,fn,arg);
+    }
+}
+
+/* Call fn for every node, parents before children and in the same order as kt_print() */
+void kt_walk(struct KT *tr, void (*fn)(const char *prefix, struct KT *node, void *arg), void *arg){
+    char name[KT_DEPTH+1];
+    kt_walk_at(tr,name,0,fn,arg);
+}
@@ -0,0 +1,64 @@
+/*
+    Key Prefix Trie
+    Aggregation behind the prefix tool. Key names are walked a character at a time until
+    the first symbol (or the 9th character) and each prefix node counts the keys, their
+    size and TTLs. prefix fills it from a dumpread out file, dumpread --aggregate-prefixes
+    fills it straight from the parse.
+*/
+
+#ifndef TRIE_H
+#define TRIE_H
+
+#include <stdint.h>
+
+/*
+    KEY_CHAR : number of max elements in trie (26 letters of alphabet, 10 numbers)
+    START LETTER and NUMBER are the decimal values for ascii characters A and 0
+    START SYM# is the offset to the Trie when compared to the decimal value of the char
+    KT_DEPTH : offset where prefix stops reading a key, 7 is where the name starts on
+        the 'Key  : NAME' line so prefixes are at most 9 characters
+*/
+#define KEY_CHAR        66
+#define START_LETTER    65
+#define START_NUMBER    22
+#define START_SYM1      -3
+#define START_SYM2      6
+#define START_SYM3      31
+#define KT_DEPTH        9
+
+/*
+    Expiry timeline spans, a key goes in the first one its TTL fits: already expired when
+    the dump was saved, within a minute, hour, day, week, 30 days, year, later, no TTL
+*/
+#define KT_SPANS        9
+#define KT_NOTTL        (KT_SPANS - 1)
+
+/*
+    Trie structure to hold all prefixes and some basic info on the keys
+    Not sure if we have prefixes that use different types, it seems that usually a prefix is
+        associated with a single Redis data type like string. More on that later...
+    ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!"#$%&'()*+,-./:;<=>?@[\]^_`
+*/
+struct KT {
+    uint8_t type; /* Redis data type */
+    uint32_t num; /* Number of keys with this token */
+    uint64_t size; /* Total size consumed by these keys */
+    uint64_t avgttl; /* average ttl in seconds */
+    uint64_t bigttl; /* largest ttl of all keys with prefix in seconds */
+    uint64_t *tl; /* KT_SPANS key counts then KT_SPANS sizes, NULL until kt_expire() */
+    struct KT *next[KEY_CHAR];
+};
+
+extern const char *kt_span_name[KT_SPANS];
+
+struct KT* create_KT();
+void free_KT(struct KT *tr);
+uint8_t kt_type(int c);
+int kt_add(struct KT *tr, const char *name, unsigned long len, uint8_t type, uint64_t size, uint64_t exp);
+int kt_expire(struct KT *tr, const char *name, unsigned long len, uint64_t size, uint8_t span);
+uint8_t kt_span(uint64_t ttl, int has_ttl);
+void kt_merge(struct KT *tr, struct KT *from);
+void kt_print(struct KT *tr, int pretty);
+void kt_walk(struct KT *tr, void (*fn)(const char *prefix, struct KT *node, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,425 @@
+/*
+    Output Writer
+    Opening, flushing and closing for the writer in writer.h.
+    The inline calls in the header cover the case where the bytes fit in the buffer,
+    everything here is the slow path.
+*/
+
+#define _GNU_SOURCE     /* for O_DIRECT and fallocate() */
+#include "writer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct OW* ow_new(int fd, int direct){
+    struct OW *w = malloc(sizeof(struct OW));
+    if(w == NULL)
+        return NULL;
+    memset(w,0,sizeof(struct OW));
+    if(posix_memalign((void**)&w->buf,OW_ALIGN,OW_BUFFER) != 0){
+        free(w);
+        return NULL;
+    }
+    w->cap = OW_BUFFER;
+    w->fd = fd;
+    w->direct = direct ? 1 : 0;
+    return w;
+}
+
+/*
+    Open path for writing, truncating whatever was there.
+    O_DIRECT isn't supported everywhere (tmpfs for one), the plain path is used if the
+    open is refused.
+*/
+struct OW* ow_open(const char *path, int direct){
+    struct OW *w;
+    int fd = -1;
+    if(direct){
+        fd = open(path,O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT,0666);
+        if(fd < 0){
+            fprintf(stderr,"WARNING : Could not open %s with O_DIRECT, using buffered writes\n",path);
+            direct = 0;
+        }
+    }
+    if(fd < 0)
+        fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd < 0)
+        return NULL;
+    w = ow_new(fd,direct);
+    if(w == NULL)
+        close(fd);
+    return w;
+}
+
+/* Anonymous scratch file, gone once it is closed */
+struct OW* ow_tmp(void){
+    struct OW *w;
+    FILE *f = tmpfile();
+    int fd;
+    if(f == NULL)
+        return NULL;
+    fd = dup(fileno(f));
+    fclose(f);
+    if(fd < 0)
+        return NULL;
+    w = ow_new(fd,0);
+    if(w == NULL)
+        close(fd);
+    return w;
+}
+
+/* A writer that keeps up to keep bytes in memory, see ow_keep() */
+struct OW* ow_mem(size_t keep){
+    struct OW *w = ow_new(-1,0);
+    if(w == NULL)
+        return NULL;
+    w->keep = keep > 0 ? keep : 1;
+    return w;
+}
+
+/*
+    Flush of an ow_mem() writer. The full buffer is chained and a new one put in its
+    place while there is room under keep, after that it is written to a scratch file
+    opened the first time it is needed. The chunks always come before the file.
+*/
+static int ow_keep(struct OW *w){
+    struct OC *c;
+    char *buf;
+    FILE *f;
+    if(w->used == 0)
+        return 0;
+    if(w->fd < 0 && w->kept + w->used <= w->keep){
+        c = malloc(sizeof(struct OC));
+        if(c != NULL && posix_memalign((void**)&buf,OW_ALIGN,w->cap) == 0){
+            c->next = NULL;
+            c->buf = w->buf;
+            c->len = w->used;
+            if(w->tail != NULL)
+                w->tail->next = c;
+            else
+                w->head = c;
+            w->tail = c;
+            w->kept += w->used;
+            w->buf = buf;
+            w->used = 0;
+            return 0;
+        }
+        free(c);
+    }
+    if(w->fd < 0){
+        f = tmpfile();
+        if(f != NULL){
+            w->fd = dup(fileno(f));
+            fclose(f);
+        }
+        if(w->fd < 0){
+            w->err = 1;
+            w->used = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+    Write n bytes of s. A direct writer reserves space well ahead first so the file
+    isn't grown a block at a time.
+*/
+static int ow_write(struct OW *w, const char *s, size_t n){
+    ssize_t got;
+    if(w->direct && w->off + n > w->alloc){
+        if(fallocate(w->fd,FALLOC_FL_KEEP_SIZE,w->alloc,OW_PREALLOC) == 0)
+            w->alloc += OW_PREALLOC;
+        else
+            w->alloc = UINT64_MAX;
+    }
+    while(n > 0){
+        got = write(w->fd,s,n);
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got <= 0){
+            w->err = 1;
+            return -1;
+        }
+        s += got;
+        n -= got;
+        w->off += got;
+    }
+    return 0;
+}
+
+/* Waiting on the other end of a queue, yield for a while then sleep */
+static void ow_backoff(unsigned int *spins){
+    struct timespec ts = {0, 50000};
+    if((*spins)++ < 64)
+        sched_yield();
+    else
+        nanosleep(&ts,NULL);
+}
+
+static void* ow_thread(void *arg){
+    struct OW *w = arg;
+    struct OQ *q = w->q;
+    unsigned long t = atomic_load_explicit(&q->tail,memory_order_relaxed);
+    unsigned int spins = 0;
+    while(1){
+        if(t == atomic_load_explicit(&q->head,memory_order_acquire)){
+            if(atomic_load_explicit(&q->done,memory_order_acquire) &&
+                    t == atomic_load_explicit(&q->head,memory_order_acquire))
+                break;
+            ow_backoff(&spins);
+            continue;
+        }
+        spins = 0;
+        /* After a failed write the rest is dropped, err is reported at the close */
+        if(!w->err)
+            ow_write(w,q->buf[t % q->n],q->len[t % q->n]);
+        atomic_store_explicit(&q->tail,++t,memory_order_release);
+    }
+    return NULL;
+}
+
+/*
+    Move the writes to a thread with n buffers between it and us.
+    On failure the writer stays synchronous, which is still correct, just slower.
+*/
+int ow_async(struct OW *w, unsigned int n){
+    struct OQ *q;
+    unsigned int i;
+    if(w->q != NULL || n < 2)
+        return -1;
+    q = calloc(1,sizeof(struct OQ));
+    if(q == NULL)
+        return -1;
+    q->n = n;
+    q->buf = calloc(n,sizeof(char*));
+    q->len = calloc(n,sizeof(size_t));
+    if(q->buf == NULL || q->len == NULL)
+        goto fail;
+    q->buf[0] = w->buf;
+    for(i=1;i<n;i++)
+        if(posix_memalign((void**)&q->buf[i],OW_ALIGN,w->cap) != 0)
+            goto fail;
+    w->q = q;
+    if(pthread_create(&q->tid,NULL,ow_thread,w) != 0){
+        w->q = NULL;
+        goto fail;
+    }
+    return 0;
+fail:
+    if(q->buf != NULL)
+        for(i=1;i<n;i++)
+            free(q->buf[i]);
+    free(q->buf);
+    free(q->len);
+    free(q);
+    return -1;
+}
+
+/* Stop the thread once everything queued is written, w keeps the buffer it is filling */
+static void ow_sync(struct OW *w){
+    struct OQ *q = w->q;
+    unsigned int i;
+    atomic_store_explicit(&q->done,1,memory_order_release);
+    pthread_join(q->tid,NULL);
+    for(i=0;i<q->n;i++)
+        if(q->buf[i] != w->buf)
+            free(q->buf[i]);
+    free(q->buf);
+    free(q->len);
+    free(q);
+    w->q = NULL;
+}
+
+/*
+    Write out the buffer. O_DIRECT writes have to be whole aligned blocks so the tail
+    that doesn't fill a block is moved to the front and goes out with the next flush.
+    An async writer queues the buffer instead and carries on in the next free one.
+*/
+int ow_flush(struct OW *w){
+    size_t n = w->used;
+    struct OQ *q = w->q;
+    unsigned long h;
+    unsigned int spins = 0;
+    char *next;
+    if(w->direct)
+        n -= n % OW_ALIGN;
+    if(w->keep > 0){
+        if(ow_keep(w) != 0)
+            return -1;
+        if(w->used == 0)
+            return 0;
+    }
+    if(q == NULL){
+        if(n > 0 && ow_write(w,w->buf,n) != 0){
+            w->used = 0;
+            return -1;
+        }
+        memmove(w->buf,w->buf+n,w->used-n);
+        w->used -= n;
+        return 0;
+    }
+    if(n == 0)
+        return 0;
+    h = atomic_load_explicit(&q->head,memory_order_relaxed);
+    q->len[h % q->n] = n;
+    atomic_store_explicit(&q->head,h+1,memory_order_release);
+    /* buf[h+1] is free once the thread is less than a lap behind */
+    while(h + 1 - atomic_load_explicit(&q->tail,memory_order_acquire) >= q->n)
+        ow_backoff(&spins);
+    next = q->buf[(h+1) % q->n];
+    memcpy(next,w->buf+n,w->used-n);
+    w->used -= n;
+    w->buf = next;
+    return 0;
+}
+
+/* Anything that doesn't fit goes through the buffer a piece at a time */
+void ow_put_slow(struct OW *w, const char *s, size_t n){
+    size_t room;
+    while(n > 0){
+        room = w->cap - w->used;
+        if(room == 0){
+            if(ow_flush(w) != 0)
+                return;
+            continue;
+        }
+        if(room > n)
+            room = n;
+        memcpy(w->buf+w->used,s,room);
+        w->used += room;
+        s += room;
+        n -= room;
+    }
+}
+
+/* Hand a chunk of an ow_mem() writer to w, a plain writer writes it as it is */
+static int ow_chunk(struct OW *w, const char *s, size_t n){
+    if(w->q == NULL && !w->direct && w->keep == 0){
+        if(ow_flush(w) != 0)
+            return -1;
+        return ow_write(w,s,n);
+    }
+    ow_put(w,s,n);
+    return w->err ? -1 : 0;
+}
+
+/* Drop the chunks of an ow_mem() writer */
+static void ow_free_chunks(struct OW *w){
+    struct OC *c, *next;
+    for(c = w->head; c != NULL; c = next){
+        next = c->next;
+        free(c->buf);
+        free(c);
+    }
+    w->head = NULL;
+    w->tail = NULL;
+    w->kept = 0;
+}
+
+/*
+    Copy everything written to src onto the end of w. The chunks of an ow_mem() writer
+    go first and are freed as they are written, then its buffer, or its scratch file
+    if it outgrew keep.
+*/
+int ow_append(struct OW *w, struct OW *src){
+    ssize_t got;
+    struct OC *c;
+    while((c = src->head) != NULL){
+        if(ow_chunk(w,c->buf,c->len) != 0)
+            return -1;
+        src->head = c->next;
+        src->kept -= c->len;
+        free(c->buf);
+        free(c);
+    }
+    src->tail = NULL;
+    if(src->keep > 0 && src->fd < 0){
+        ow_put(w,src->buf,src->used);
+        src->used = 0;
+        return w->err ? -1 : 0;
+    }
+    if(ow_flush(src) != 0 || lseek(src->fd,0,SEEK_SET) != 0)
+        return -1;
+    while(1){
+        if(w->used == w->cap && ow_flush(w) != 0)
+            return -1;
+        got = read(src->fd,w->buf+w->used,w->cap-w->used);
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got < 0)
+            return -1;
+        if(got == 0)
+            break;
+        w->used += got;
+    }
+    return 0;
+}
+
+/* Empty a writer from ow_tmp() or ow_mem() so it can be written again from the start */
+int ow_reset(struct OW *w){
+    w->used = 0;
+    w->off = 0;
+    ow_free_chunks(w);
+    if(w->fd < 0)
+        return 0;
+    if(ftruncate(w->fd,0) != 0 || lseek(w->fd,0,SEEK_SET) != 0)
+        return -1;
+    return 0;
+}
+
+/*
+    Flush what is left and close. An O_DIRECT file gets its last partial block written
+    with O_DIRECT turned off.
+*/
+int ow_close(struct OW *w){
+    int rc;
+    if(w == NULL)
+        return 0;
+    ow_flush(w);
+    if(w->q != NULL)
+        ow_sync(w);
+    if(w->direct && w->used > 0){
+        fcntl(w->fd,F_SETFL,fcntl(w->fd,F_GETFL) & ~O_DIRECT);
+        w->direct = 0;
+        ow_flush(w);
+    }
+    if(w->fd >= 0 && close(w->fd) != 0)
+        w->err = 1;
+    ow_free_chunks(w);
+    rc = w->err ? -1 : 0;
+    free(w->buf);
+    free(w);
+    return rc;
+}
+
+/*
+    Integer to text without printf, two digits at a time out of a table.
+    dst needs 20 bytes, the length is returned and nothing is NUL terminated.
+*/
+static const char digits2[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+int ow_utoa(char *dst, uint64_t v){
+    char tmp[20];
+    int i = 20, n;
+    while(v >= 100){
+        i -= 2;
+        memcpy(tmp+i,digits2+(v % 100)*2,2);
+        v /= 100;
+    }
+    if(v >= 10){
+        i -= 2;
+        memcpy(tmp+i,digits2+v*2,2);
+    } else {
+        tmp[--i] = '0' + v;
+    }
+    n = 20 - i;
+    memcpy(dst,tmp+i,n);
+    return n;
+}
@@ -0,0 +1,134 @@
+/*
+    Output Writer
+    Buffered writer for the dumpread out file. Records are put together in a large buffer
+    with plain memcpy and a hand rolled integer emitter instead of going through the
+    format parsing in fprintf for every line, and each flush is a single write(2).
+    With direct set the file is opened O_DIRECT and space is fallocate'd ahead of the
+    writes, for multi GB outputs that shouldn't go through the page cache.
+    ow_async() hands the writes to a thread of their own, full buffers are passed over a
+    single producer/single consumer ring so filling the next one overlaps the write.
+    ow_mem() keeps its full buffers in memory instead, up to a cap and then in a scratch
+    file, for output that is copied into another writer later with ow_append().
+*/
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#define OW_BUFFER           (4 << 20)
+#define OW_ALIGN            4096
+#define OW_PREALLOC         (256 << 20)
+
+/*
+    OQ : Output Queue, the ring between an async writer and its thread
+        buf  = the ring's buffers, the writer fills buf[head % n]
+        len  = bytes to write out of each buffer
+        n    = number of buffers
+        head = buffers handed to the thread, only the writer moves it
+        tail = buffers written, only the thread moves it
+        done = no more buffers are coming
+*/
+struct OQ {
+    char **buf;
+    size_t *len;
+    unsigned int n;
+    _Alignas(64) atomic_ulong head;
+    _Alignas(64) atomic_ulong tail;
+    atomic_int done;
+    pthread_t tid;
+};
+
+/*
+    OC : Output Chunk, a full buffer kept by an ow_mem() writer
+        next = following chunk
+        buf  = the buffer, taken over from the writer
+        len  = bytes in buf
+*/
+struct OC {
+    struct OC *next;
+    char *buf;
+    size_t len;
+};
+
+/*
+    OW : Output Writer
+        buf   = output buffer, block aligned for O_DIRECT
+        used  = bytes waiting in buf
+        cap   = size of buf
+        off   = bytes written to fd so far
+        alloc = file space fallocate'd so far
+        fd    = file being written
+        direct = fd is O_DIRECT, only whole blocks are written until the close
+        err   = a write failed, sticky like ferror()
+        q     = queue to the writing thread, NULL when writes are done inline
+        head  = ow_mem() chunks in the order they were filled, tail is the last one
+        kept  = bytes in the chunks
+        keep  = most bytes kept in chunks, past it flushes go to a scratch file. 0 for
+                writers that aren't ow_mem(), whose fd is -1 until the file is opened
+    off, alloc and err belong to whichever thread does the writes, so they are plain
+    bytes rather than bit fields sharing a byte with the rest.
+*/
+struct OW {
+    char *buf;
+    size_t used;
+    size_t cap;
+    uint64_t off;
+    uint64_t alloc;
+    int fd;
+    uint8_t direct;
+    uint8_t err;
+    struct OQ *q;
+    struct OC *head;
+    struct OC *tail;
+    size_t kept;
+    size_t keep;
+};
+
+struct OW* ow_open(const char *path, int direct);
+struct OW* ow_tmp(void);
+struct OW* ow_mem(size_t keep);
+int ow_async(struct OW *w, unsigned int n);
+int ow_flush(struct OW *w);
+int ow_close(struct OW *w);
+int ow_append(struct OW *w, struct OW *src);
+int ow_reset(struct OW *w);
+void ow_put_slow(struct OW *w, const char *s, size_t n);
+int ow_utoa(char *dst, uint64_t v);
+
+static inline void ow_put(struct OW *w, const char *s, size_t n){
+    if(w->cap - w->used < n){
+        ow_put_slow(w,s,n);
+        return;
+    }
+    memcpy(w->buf+w->used,s,n);
+    w->used += n;
+}
+
+static inline void ow_putc(struct OW *w, char c){
+    if(w->used == w->cap)
+        ow_flush(w);
+    w->buf[w->used++] = c;
+}
+
+/* NUL terminated, NULL comes out as (null) the same as printf did */
+static inline void ow_puts(struct OW *w, const char *s){
+    if(s == NULL)
+        s = "(null)";
+    ow_put(w,s,strlen(s));
+}
+
+static inline void ow_u64(struct OW *w, uint64_t v){
+    if(w->cap - w->used < 20)
+        ow_flush(w);
+    w->used += ow_utoa(w->buf+w->used,v);
+}
+
+static inline int ow_error(struct OW *w){
+    return w->err;
+}
+
+#endif